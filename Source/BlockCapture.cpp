@@ -0,0 +1,164 @@
+#include "BlockCapture.h"
+
+//==============================================================================
+BlockCapture::BlockCapture(std::unique_ptr<juce::FileOutputStream> output,
+    const juce::Array<juce::AudioProcessorParameter*>& processorParameters)
+    : juce::Thread("Block capture writer"),
+    stream(std::move(output)),
+    parameters(processorParameters)
+{
+    ring.allocate((size_t)fifo.getTotalSize(), false);
+
+    // Nothing counts as logged yet, so the first block records every
+    // parameter exactly and later blocks only what changed
+    loggedValues.resize((size_t)parameters.size(), std::numeric_limits<float>::quiet_NaN());
+    changedParameters.reserve((size_t)parameters.size());
+
+    startThread();
+}
+
+BlockCapture::~BlockCapture()
+{
+    stopThread(2000);
+    drain();
+    stream->flush();
+}
+
+void BlockCapture::run()
+{
+    while (!threadShouldExit())
+    {
+        drain();
+        wait(10);
+    }
+}
+
+void BlockCapture::drain()
+{
+    const auto scope = fifo.read(fifo.getNumReady());
+
+    if (scope.blockSize1 > 0)
+        stream->write(ring + scope.startIndex1, (size_t)scope.blockSize1);
+
+    if (scope.blockSize2 > 0)
+        stream->write(ring + scope.startIndex2, (size_t)scope.blockSize2);
+}
+
+//==============================================================================
+bool BlockCapture::reserve(int size) noexcept
+{
+    if (overflowed.load())
+        return false;
+
+    // Only this thread writes, so the space can't shrink before it's used
+    if (fifo.getFreeSpace() < size)
+    {
+        overflowed = true;
+        return false;
+    }
+
+    return true;
+}
+
+void BlockCapture::write(const void* data, int size) noexcept
+{
+    const auto scope = fifo.write(size);
+    auto* bytes = static_cast<const char*>(data);
+
+    if (scope.blockSize1 > 0)
+        memcpy(ring + scope.startIndex1, bytes, (size_t)scope.blockSize1);
+
+    if (scope.blockSize2 > 0)
+        memcpy(ring + scope.startIndex2, bytes + scope.blockSize1, (size_t)scope.blockSize2);
+}
+
+void BlockCapture::writeBlock(const juce::AudioBuffer<float>& buffer, int numInputChannels, double sampleRate,
+    const juce::MidiBuffer& midiMessages)
+{
+    auto numSamples = buffer.getNumSamples();
+    numInputChannels = juce::jmin(numInputChannels, buffer.getNumChannels());
+
+    changedParameters.clear();
+    for (int i = 0; i < parameters.size(); ++i)
+        if (parameters.getUnchecked(i)->getValue() != loggedValues[i])
+            changedParameters.push_back((juce::uint16)i);
+
+    int numEvents = 0;
+    int midiBytes = 0;
+    for (const auto metadata : midiMessages)
+    {
+        ++numEvents;
+        midiBytes += metadata.numBytes;
+    }
+
+    auto size = 1 + 4 + 8 + 1
+        + numInputChannels * numSamples * 4
+        + 4 + numEvents * (4 + 2) + midiBytes
+        + 2 + (int)changedParameters.size() * (2 + 4);
+
+    if (!reserve(size))
+        return;
+
+    writeValue<juce::uint8>(blockRecord);
+    writeValue<juce::int32>(numSamples);
+    writeValue<double>(sampleRate);
+
+    // The input is only ever a couple of channels, and the drum replacement
+    // and effect builds both depend on it
+    writeValue<juce::uint8>((juce::uint8)numInputChannels);
+    for (int channel = 0; channel < numInputChannels; ++channel)
+        write(buffer.getReadPointer(channel), numSamples * 4);
+
+    writeValue<juce::int32>(numEvents);
+    for (const auto metadata : midiMessages)
+    {
+        writeValue<juce::int32>(metadata.samplePosition);
+        writeValue<juce::uint16>((juce::uint16)metadata.numBytes);
+        write(metadata.data, metadata.numBytes);
+    }
+
+    writeValue<juce::uint16>((juce::uint16)changedParameters.size());
+    for (auto index : changedParameters)
+    {
+        auto value = parameters.getUnchecked(index)->getValue();
+        writeValue<juce::uint16>(index);
+        writeValue<float>(value);
+        loggedValues[index] = value;
+    }
+}
+
+void BlockCapture::writeTrigger(int drumIndex, float velocity)
+{
+    if (!reserve(1 + 4 + 4))
+        return;
+
+    writeValue<juce::uint8>(triggerRecord);
+    writeValue<juce::int32>(drumIndex);
+    writeValue<float>(velocity);
+}
+
+void BlockCapture::writeRender(const juce::AudioBuffer<float>& buffer, int numOutputChannels, double renderSeconds)
+{
+    if (!reserve(1 + 8 + 8))
+        return;
+
+    writeValue<juce::uint8>(renderRecord);
+    writeValue<double>(renderSeconds);
+    writeValue<juce::uint64>(hashOutput(buffer, numOutputChannels));
+}
+
+juce::uint64 BlockCapture::hashOutput(const juce::AudioBuffer<float>& buffer, int numChannels) noexcept
+{
+    juce::uint64 hash = 14695981039346656037ull;
+
+    for (int channel = 0; channel < juce::jmin(numChannels, buffer.getNumChannels()); ++channel)
+    {
+        auto* bytes = reinterpret_cast<const juce::uint8*>(buffer.getReadPointer(channel));
+        auto numBytes = (size_t)buffer.getNumSamples() * sizeof(float);
+
+        for (size_t i = 0; i < numBytes; ++i)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+
+    return hash;
+}
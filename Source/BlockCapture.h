@@ -0,0 +1,70 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+// Records everything processBlock is given, so a session can be replayed
+// offline with the CaptureReplay tool (Tools/CaptureReplay).
+//
+// The file starts with a header describing the processor's setup, written by
+// the processor on the message thread. The audio thread then appends one
+// record per block, pad hit and render, into a lock-free ring that a writer
+// thread drains to disk. If the ring ever fills, recording stops so the file
+// always holds an unbroken run of blocks.
+//
+// Records use the machine's native byte order; replay on the same platform.
+class BlockCapture : private juce::Thread
+{
+public:
+    enum RecordType : juce::uint8
+    {
+        blockRecord = 'B',    // block size, sample rate, input audio, MIDI, parameter changes
+        triggerRecord = 'G',  // pad hit from the editor, taken at the top of the preceding block
+        renderRecord = 'R'    // render time and a hash of the block's output
+    };
+
+    static constexpr juce::uint32 fileMagic = 0x50435a58; // "XZCP"
+    static constexpr juce::uint32 fileVersion = 3;
+
+    // Takes ownership of the stream, which already holds the header, and
+    // starts draining records into it
+    BlockCapture(std::unique_ptr<juce::FileOutputStream> output,
+        const juce::Array<juce::AudioProcessorParameter*>& parameters);
+    ~BlockCapture() override;
+
+    // Audio thread only
+    void writeBlock(const juce::AudioBuffer<float>& buffer, int numInputChannels, double sampleRate,
+        const juce::MidiBuffer& midiMessages);
+    void writeTrigger(int drumIndex, float velocity);
+    void writeRender(const juce::AudioBuffer<float>& buffer, int numOutputChannels, double renderSeconds);
+
+    bool hasOverflowed() const noexcept { return overflowed.load(); }
+
+    // FNV-1a over the raw bits of the first numChannels channels
+    static juce::uint64 hashOutput(const juce::AudioBuffer<float>& buffer, int numChannels) noexcept;
+
+private:
+    void run() override;
+    void drain();
+
+    // Fails, and stops the capture, if size bytes won't fit in the ring
+    bool reserve(int size) noexcept;
+    void write(const void* data, int size) noexcept;
+
+    template <typename Type>
+    void writeValue(Type value) noexcept { write(&value, (int)sizeof(Type)); }
+
+    std::unique_ptr<juce::FileOutputStream> stream;
+    const juce::Array<juce::AudioProcessorParameter*> parameters;
+
+    juce::AbstractFifo fifo { 1 << 22 };
+    juce::HeapBlock<char> ring;
+
+    // Last value logged for each parameter, and the ones changed this block
+    std::vector<float> loggedValues;
+    std::vector<juce::uint16> changedParameters;
+
+    std::atomic<bool> overflowed { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BlockCapture)
+};
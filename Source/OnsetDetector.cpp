@@ -0,0 +1,118 @@
+#include "OnsetDetector.h"
+
+//==============================================================================
+void OnsetDetector::prepare(double sampleRate, int lookaheadSamples)
+{
+    lookahead = juce::jmax(hopSize, lookaheadSamples);
+
+    // Ignore re-hits within 30 ms, and track the background level over ~50 ms
+    holdoffSamples = (int)(sampleRate * 0.03);
+    auto hopsPerSecond = sampleRate / hopSize;
+    slowCoefficient = (float)std::exp(-1.0 / (0.05 * hopsPerSecond));
+
+    reset();
+}
+
+void OnsetDetector::reset()
+{
+    slowEnvelope = 0.0f;
+    hopPeak = 0.0f;
+    hopFill = 0;
+    holdoffRemaining = 0;
+    measuring = false;
+    measureRemaining = 0;
+    measuredPeak = 0.0f;
+    hasCarriedOnset = false;
+}
+
+void OnsetDetector::setThresholdDb(float newThresholdDb) noexcept
+{
+    thresholdDb = juce::jmin(-1.0f, newThresholdDb);
+    threshold = juce::Decibels::decibelsToGain(thresholdDb);
+}
+
+float OnsetDetector::getVelocity(float peak) const noexcept
+{
+    // Hits just over the threshold still play quietly rather than not at all
+    auto proportion = 1.0f - juce::Decibels::gainToDecibels(peak) / thresholdDb;
+    return juce::jmap(juce::jlimit(0.0f, 1.0f, proportion), 0.1f, 1.0f);
+}
+
+int OnsetDetector::process(const float* input, int numSamples, Onset* onsets, int maxOnsets)
+{
+    int numOnsets = 0;
+
+    auto addOnset = [&](int position, float velocity)
+    {
+        // A hit landing on the block end belongs to the next block's first sample
+        if (position >= numSamples)
+        {
+            hasCarriedOnset = true;
+            carriedVelocity = velocity;
+        }
+        else if (numOnsets < maxOnsets)
+        {
+            onsets[numOnsets++] = { position, velocity };
+        }
+    };
+
+    if (hasCarriedOnset)
+    {
+        hasCarriedOnset = false;
+        addOnset(0, carriedVelocity);
+    }
+
+    int position = 0;
+    while (position < numSamples)
+    {
+        auto chunk = juce::jmin(numSamples - position, hopSize - hopFill);
+        if (measuring)
+            chunk = juce::jmin(chunk, measureRemaining);
+
+        auto range = juce::FloatVectorOperations::findMinAndMax(input + position, chunk);
+        auto peak = juce::jmax(-range.getStart(), range.getEnd());
+
+        if (measuring)
+        {
+            measuredPeak = juce::jmax(measuredPeak, peak);
+            measureRemaining -= chunk;
+        }
+        else if (holdoffRemaining <= 0 && peak >= getTriggerLevel())
+        {
+            // Only now look at individual samples, to find where the hit starts
+            auto level = getTriggerLevel();
+            auto first = 0;
+            while (std::abs(input[position + first]) < level)
+                ++first;
+
+            auto rest = juce::FloatVectorOperations::findMinAndMax(input + position + first, chunk - first);
+            measuring = true;
+            measuredPeak = juce::jmax(-rest.getStart(), rest.getEnd());
+            measureRemaining = lookahead - (chunk - first);
+            holdoffRemaining = holdoffSamples + first;
+        }
+
+        if (measuring && measureRemaining == 0)
+        {
+            measuring = false;
+            addOnset(position + chunk, getVelocity(measuredPeak));
+        }
+
+        holdoffRemaining -= chunk;
+
+        // The slow envelope moves once per full hop
+        hopPeak = juce::jmax(hopPeak, peak);
+        hopFill += chunk;
+
+        if (hopFill == hopSize)
+        {
+            slowEnvelope = hopPeak + slowCoefficient * (slowEnvelope - hopPeak);
+            hopPeak = 0.0f;
+            hopFill = 0;
+        }
+
+        position += chunk;
+    }
+
+    return numOnsets;
+}
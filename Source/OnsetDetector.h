@@ -0,0 +1,58 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+// Finds drum hits in one channel of audio input.
+//
+// Block peaks are taken a few samples at a time with vectorised min/max, and
+// compared against a threshold and a slow envelope of the signal, so the
+// cost per block is small and fixed. When a hit is found, its exact first
+// sample is located and its velocity is taken from the peak over the
+// following lookahead window. Hits are therefore reported exactly
+// lookahead samples after they happen, which the caller reports as latency.
+class OnsetDetector
+{
+public:
+    struct Onset
+    {
+        int samplePosition = 0;  // within the block being processed
+        float velocity = 0.0f;   // peak level in dB, scaled from the threshold up to full scale
+    };
+
+    void prepare(double sampleRate, int lookaheadSamples);
+    void reset();
+
+    void setThresholdDb(float newThresholdDb) noexcept;
+
+    // Scans a block and writes up to maxOnsets hits, in order. Returns the
+    // number written.
+    int process(const float* input, int numSamples, Onset* onsets, int maxOnsets);
+
+    static constexpr int hopSize = 16;
+
+private:
+    float getTriggerLevel() const noexcept { return juce::jmax(threshold, slowEnvelope * riseRatio); }
+    float getVelocity(float peak) const noexcept;
+
+    static constexpr float riseRatio = 2.0f;   // 6 dB above the recent level
+
+    int lookahead = hopSize;
+    int holdoffSamples = 0;
+    float thresholdDb = -30.0f;
+    float threshold = juce::Decibels::decibelsToGain(-30.0f);
+    float slowCoefficient = 0.0f;
+
+    float slowEnvelope = 0.0f;
+    float hopPeak = 0.0f;
+    int hopFill = 0;
+    int holdoffRemaining = 0;
+
+    bool measuring = false;
+    int measureRemaining = 0;
+    float measuredPeak = 0.0f;
+
+    // A hit whose lookahead ended exactly on the previous block's boundary
+    bool hasCarriedOnset = false;
+    float carriedVelocity = 0.0f;
+};
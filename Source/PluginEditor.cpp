@@ -82,12 +82,7 @@ void DrumSimulatorAudioProcessorEditor::paint(juce::Graphics& g)
     g.setGradientFill(gradient);
     g.fillAll();
 
-    // Draw drum pads
-    for (const auto& pad : drumPads)
-    {
-        drawDrumPad(g, pad);
-    }
-     g.fillAll(getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
+    g.fillAll(getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
 
     if (drumKitImage.isValid())
     {
@@ -97,6 +92,16 @@ void DrumSimulatorAudioProcessorEditor::paint(juce::Graphics& g)
     g.setColour(juce::Colours::white);
     g.setFont(15.0f);
     g.drawFittedText("Drum Tester", getLocalBounds(), juce::Justification::centredTop, 1);
+
+    // The default kit's pads are the drums in the picture, so only their
+    // waveforms go on top; pads beyond it are drawn in full
+    for (int i = 0; i < numVisiblePads; ++i)
+    {
+        if (i < DrumSimulatorAudioProcessor::NUM_DEFAULT_SOUNDS)
+            drawWaveform(g, drumPads[i], drumPads[i].bounds.toFloat().reduced(6.0f));
+        else
+            drawDrumPad(g, drumPads[i]);
+    }
 }
 
 
@@ -135,9 +140,28 @@ void DrumSimulatorAudioProcessorEditor::resized()
     drumPads[DrumSimulatorAudioProcessor::TOM3].bounds = juce::Rectangle<int>(550, 160, 100, 100);
     drumPads[DrumSimulatorAudioProcessor::RIDE].bounds = juce::Rectangle<int>(650, 350, 120, 120);
 
+    // Pads beyond the default kit sit in a grid above the drum kit
+    auto numExtraPads = numVisiblePads - DrumSimulatorAudioProcessor::NUM_DEFAULT_SOUNDS;
+    if (numExtraPads > 0)
+    {
+        auto extraArea = juce::Rectangle<int>(margin, 45, getWidth() - 2 * margin, 110);
+        auto columns = juce::jmin(numExtraPads, 16);
+        auto rows = (numExtraPads + columns - 1) / columns;
+        auto cellWidth = extraArea.getWidth() / columns;
+        auto cellHeight = extraArea.getHeight() / rows;
+
+        for (int i = 0; i < numExtraPads; ++i)
+        {
+            drumPads[DrumSimulatorAudioProcessor::NUM_DEFAULT_SOUNDS + i].bounds = juce::Rectangle<int>(
+                extraArea.getX() + (i % columns) * cellWidth, extraArea.getY() + (i / columns) * cellHeight,
+                cellWidth, cellHeight).reduced(2);
+        }
+    }
+
     // Layout drum pad buttons
-    for (auto& pad : drumPads)
+    for (int i = 0; i < numVisiblePads; ++i)
     {
+        auto& pad = drumPads[i];
         if (pad.button)
         {
             auto buttonArea = pad.bounds.reduced(5);
@@ -145,27 +169,34 @@ void DrumSimulatorAudioProcessorEditor::resized()
         }
     }
 
-    // Layout controls in the controls area
+    // Layout controls in the controls area, up to 16 per row for large kits
     auto controlsInnerArea = controlsArea.reduced(20);
-    int sliderWidth = controlsInnerArea.getWidth() / 8 - 5;
+    int columns = juce::jlimit(8, 16, numVisiblePads);
+    int rows = (numVisiblePads + columns - 1) / columns;
+    int sliderWidth = controlsInnerArea.getWidth() / columns - 5;
+    int rowHeight = rows > 1 ? controlsInnerArea.getHeight() / rows : 140;
 
-    for (int i = 0; i < DrumSimulatorAudioProcessor::NUM_SOUNDS; ++i)
+    for (int i = 0; i < numVisiblePads; ++i)
     {
         auto& pad = drumPads[i];
-        int x = controlsInnerArea.getX() + i * (sliderWidth + 5);
+        int x = controlsInnerArea.getX() + (i % columns) * (sliderWidth + 5);
+        int y = controlsInnerArea.getY() + (i / columns) * rowHeight;
+        int sliderHeight = juce::jmax(10, rowHeight - 60);
 
         if (pad.gainLabel)
-            pad.gainLabel->setBounds(x, controlsInnerArea.getY(), sliderWidth, 20);
+            pad.gainLabel->setBounds(x, y, sliderWidth, 20);
         if (pad.gainSlider)
-            pad.gainSlider->setBounds(x, controlsInnerArea.getY() + 25, sliderWidth, 80);
+            pad.gainSlider->setBounds(x, y + 25, sliderWidth, sliderHeight);
         if (pad.loadButton)
-            pad.loadButton->setBounds(x, controlsInnerArea.getY() + 110, sliderWidth, 30);
+            pad.loadButton->setBounds(x, y + 30 + sliderHeight, sliderWidth, 30);
     }
 }
 
 //==============================================================================
 void DrumSimulatorAudioProcessorEditor::setupDrumPads()
 {
+    numVisiblePads = audioProcessor.getNumPads();
+
     setupDrumPad(DrumSimulatorAudioProcessor::KICK, "", juce::Colours::transparentWhite, juce::KeyPress('q'));
     setupDrumPad(DrumSimulatorAudioProcessor::SNARE, "", juce::Colours::orange, juce::KeyPress('w'));
     setupDrumPad(DrumSimulatorAudioProcessor::HIHAT, "", juce::Colours::yellow, juce::KeyPress('e'));
@@ -174,11 +205,39 @@ void DrumSimulatorAudioProcessorEditor::setupDrumPads()
     setupDrumPad(DrumSimulatorAudioProcessor::TOM2, "", juce::Colours::indigo, juce::KeyPress('s'));
     setupDrumPad(DrumSimulatorAudioProcessor::TOM3, "", juce::Colours::violet, juce::KeyPress('d'));
     setupDrumPad(DrumSimulatorAudioProcessor::RIDE, "", juce::Colours::cyan, juce::KeyPress('f'));
+
+    // Extra pads get evenly spread colours and no key binding
+    for (int i = DrumSimulatorAudioProcessor::NUM_DEFAULT_SOUNDS; i < numVisiblePads; ++i)
+    {
+        auto hue = (float)(i - DrumSimulatorAudioProcessor::NUM_DEFAULT_SOUNDS) / (float)(numVisiblePads - DrumSimulatorAudioProcessor::NUM_DEFAULT_SOUNDS);
+        setupDrumPad(i, juce::String(i + 1), juce::Colour::fromHSV(hue, 0.6f, 0.8f, 1.0f), juce::KeyPress());
+    }
+}
+
+void DrumSimulatorAudioProcessorEditor::rebuildDrumPads()
+{
+    for (int i = 0; i < DrumSimulatorAudioProcessor::maxPads; ++i)
+    {
+        auto& pad = drumPads[i];
+        gainAttachments[i].reset();
+        pad.button.reset();
+        pad.gainSlider.reset();
+        pad.gainLabel.reset();
+        pad.loadButton.reset();
+        pad.isPressed = false;
+    }
+
+    setupDrumPads();
+    resized();
+    repaint();
 }
 
 void DrumSimulatorAudioProcessorEditor::setupDrumPad(int index, const juce::String& name,
     juce::Colour color, juce::KeyPress key)
 {
+    if (index >= numVisiblePads)
+        return;
+
     auto& pad = drumPads[index];
     pad.name = name;
     pad.padColor = color;
@@ -222,21 +281,8 @@ void DrumSimulatorAudioProcessorEditor::setupDrumPad(int index, const juce::Stri
     addAndMakeVisible(*pad.loadButton);
 
     // Setup parameter attachment
-    juce::String paramId;
-    switch (index)
-    {
-    case DrumSimulatorAudioProcessor::KICK: paramId = "kick_gain"; break;
-    case DrumSimulatorAudioProcessor::SNARE: paramId = "snare_gain"; break;
-    case DrumSimulatorAudioProcessor::HIHAT: paramId = "hihat_gain"; break;
-    case DrumSimulatorAudioProcessor::CRASH: paramId = "crash_gain"; break;
-    case DrumSimulatorAudioProcessor::TOM1: paramId = "tom1_gain"; break;
-    case DrumSimulatorAudioProcessor::TOM2: paramId = "tom2_gain"; break;
-    case DrumSimulatorAudioProcessor::TOM3: paramId = "tom3_gain"; break;
-    case DrumSimulatorAudioProcessor::RIDE: paramId = "ride_gain"; break;
-    }
-
     gainAttachments[index] = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment>(
-        audioProcessor.parameters, paramId, *pad.gainSlider);
+        audioProcessor.parameters, DrumSimulatorAudioProcessor::getGainParameterId(index), *pad.gainSlider);
 }
 
 void DrumSimulatorAudioProcessorEditor::drawDrumPad(juce::Graphics& g, const DrumPad& pad)
@@ -255,6 +301,8 @@ void DrumSimulatorAudioProcessorEditor::drawDrumPad(juce::Graphics& g, const Dru
     g.setColour(bgColor);
     g.fillRoundedRectangle(bounds, 10.0f);
 
+    drawWaveform(g, pad, bounds.reduced(6.0f));
+
     // Draw border
     g.setColour(pad.padColor.darker(0.3f));
     g.drawRoundedRectangle(bounds, 10.0f, 2.0f);
@@ -272,9 +320,30 @@ void DrumSimulatorAudioProcessorEditor::drawDrumPad(juce::Graphics& g, const Dru
     }
 }
 
+void DrumSimulatorAudioProcessorEditor::drawWaveform(juce::Graphics& g, const DrumPad& pad, juce::Rectangle<float> area)
+{
+    // Nothing to draw until the background analysis has produced it
+    auto analysis = audioProcessor.getDrumAnalysis(pad.drumIndex);
+    if (analysis == nullptr)
+        return;
+
+    auto numColumns = (int)area.getWidth();
+    auto halfHeight = area.getHeight() * 0.5f;
+    auto scale = analysis->getPeak() > 0.0f ? halfHeight / analysis->getPeak() : 0.0f;
+
+    g.setColour(juce::Colours::white.withAlpha(0.35f));
+    for (int x = 0; x < numColumns; ++x)
+    {
+        auto range = analysis->getColumnRange(x, numColumns);
+        g.drawVerticalLine((int)area.getX() + x,
+            area.getCentreY() - range.getEnd() * scale,
+            area.getCentreY() - range.getStart() * scale);
+    }
+}
+
 void DrumSimulatorAudioProcessorEditor::triggerDrumPad(int index)
 {
-    if (index >= 0 && index < DrumSimulatorAudioProcessor::NUM_SOUNDS)
+    if (index >= 0 && index < numVisiblePads)
     {
         audioProcessor.triggerDrum(index, 1.0f);
         drumPads[index].isPressed = true;
@@ -303,7 +372,7 @@ void DrumSimulatorAudioProcessorEditor::loadSampleForDrum(int drumIndex)
 //==============================================================================
 bool DrumSimulatorAudioProcessorEditor::keyPressed(const juce::KeyPress& key, juce::Component* /*originatingComponent*/)
 {
-    for (int i = 0; i < DrumSimulatorAudioProcessor::NUM_SOUNDS; ++i)
+    for (int i = 0; i < numVisiblePads; ++i)
     {
         if (drumPads[i].keyBinding == key)
         {
@@ -316,6 +385,10 @@ bool DrumSimulatorAudioProcessorEditor::keyPressed(const juce::KeyPress& key, ju
 
 void DrumSimulatorAudioProcessorEditor::timerCallback()
 {
+    // Follow kit size changes made by the host or a restored session
+    if (audioProcessor.getNumPads() != numVisiblePads)
+        rebuildDrumPads();
+
     // Reset pressed states for visual feedback
     bool needsRepaint = false;
     for (auto& pad : drumPads)
@@ -327,6 +400,17 @@ void DrumSimulatorAudioProcessorEditor::timerCallback()
         }
     }
 
+    // Redraw pads whose waveform analysis has just finished or been replaced
+    for (int i = 0; i < numVisiblePads; ++i)
+    {
+        auto* analysis = audioProcessor.getDrumAnalysis(i).get();
+        if (drumPads[i].drawnAnalysis != analysis)
+        {
+            drumPads[i].drawnAnalysis = analysis;
+            needsRepaint = true;
+        }
+    }
+
     if (needsRepaint)
         repaint();
 }
@@ -334,7 +418,7 @@ void DrumSimulatorAudioProcessorEditor::timerCallback()
 void DrumSimulatorAudioProcessorEditor::buttonClicked(juce::Button* button)
 {
     // Check if it's a drum pad button
-    for (int i = 0; i < DrumSimulatorAudioProcessor::NUM_SOUNDS; ++i)
+    for (int i = 0; i < numVisiblePads; ++i)
     {
         auto& pad = drumPads[i];
         if (button == pad.button.get())
@@ -41,6 +41,7 @@ private:
         juce::String name;
         juce::KeyPress keyBinding;
         bool isPressed = false;
+        const SampleAnalysis* drawnAnalysis = nullptr;
         int drumIndex;
 
         DrumPad() = default;
@@ -57,15 +58,18 @@ private:
 
     //==============================================================================
     void setupDrumPads();
+    void rebuildDrumPads();
     void setupDrumPad(int index, const juce::String& name, juce::Colour color, juce::KeyPress key);
     void drawDrumPad(juce::Graphics& g, const DrumPad& pad);
+    void drawWaveform(juce::Graphics& g, const DrumPad& pad, juce::Rectangle<float> area);
     void triggerDrumPad(int index);
     void loadSampleForDrum(int drumIndex);
 
     //==============================================================================
     DrumSimulatorAudioProcessor& audioProcessor;
 
-    std::array<DrumPad, DrumSimulatorAudioProcessor::NUM_SOUNDS> drumPads;
+    std::array<DrumPad, DrumSimulatorAudioProcessor::maxPads> drumPads;
+    int numVisiblePads = 0;
 
     // UI Components
     std::unique_ptr<juce::Label> titleLabel;
@@ -76,7 +80,7 @@ private:
 
     // Parameter attachments
     using SliderAttachment = juce::AudioProcessorValueTreeState::SliderAttachment;
-    std::array<std::unique_ptr<SliderAttachment>, DrumSimulatorAudioProcessor::NUM_SOUNDS> gainAttachments;
+    std::array<std::unique_ptr<SliderAttachment>, DrumSimulatorAudioProcessor::maxPads> gainAttachments;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DrumSimulatorAudioProcessorEditor)
 };
\ No newline at end of file
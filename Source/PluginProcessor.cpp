@@ -8,41 +8,43 @@ DrumSimulatorAudioProcessor::DrumSimulatorAudioProcessor()
 #if ! JucePlugin_IsMidiEffect
 #if ! JucePlugin_IsSynth
         .withInput("Input", juce::AudioChannelSet::stereo(), true)
+#else
+        .withInput("Drum Input", juce::AudioChannelSet::stereo(), false)
 #endif
         .withOutput("Output", juce::AudioChannelSet::stereo(), true)
 #endif
     ),
 #endif
-    parameters(*this, nullptr, juce::Identifier("DrumSimulator"),
-        {
-            std::make_unique<juce::AudioParameterFloat>("kick_gain", "Kick Gain", 0.0f, 2.0f, 1.0f),
-            std::make_unique<juce::AudioParameterFloat>("snare_gain", "Snare Gain", 0.0f, 2.0f, 1.0f),
-            std::make_unique<juce::AudioParameterFloat>("hihat_gain", "Hi-Hat Gain", 0.0f, 2.0f, 1.0f),
-            std::make_unique<juce::AudioParameterFloat>("crash_gain", "Crash Gain", 0.0f, 2.0f, 1.0f),
-            std::make_unique<juce::AudioParameterFloat>("tom1_gain", "Tom 1 Gain", 0.0f, 2.0f, 1.0f),
-            std::make_unique<juce::AudioParameterFloat>("tom2_gain", "Tom 2 Gain", 0.0f, 2.0f, 1.0f),
-            std::make_unique<juce::AudioParameterFloat>("tom3_gain", "Tom 3 Gain", 0.0f, 2.0f, 1.0f),
-            std::make_unique<juce::AudioParameterFloat>("ride_gain", "Ride Gain", 0.0f, 2.0f, 1.0f)
-        })
-{
-    // Register basic audio formats
-    formatManager.registerBasicFormats();
-
-    // Setup drum names
-    setupDrumNames();
+    parameters(*this, nullptr, juce::Identifier("DrumSimulator"), createParameterLayout())
+{
+    // Setup drum names and MIDI notes
+    setupDrumSlots();
 
     // Get parameter pointers
-    gainParameters[KICK] = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter("kick_gain"));
-    gainParameters[SNARE] = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter("snare_gain"));
-    gainParameters[HIHAT] = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter("hihat_gain"));
-    gainParameters[CRASH] = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter("crash_gain"));
-    gainParameters[TOM1] = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter("tom1_gain"));
-    gainParameters[TOM2] = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter("tom2_gain"));
-    gainParameters[TOM3] = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter("tom3_gain"));
-    gainParameters[RIDE] = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter("ride_gain"));
+    for (int i = 0; i < maxPads; ++i)
+    {
+        gainParameters[i] = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter(getGainParameterId(i)));
+        normaliseParameters[i] = dynamic_cast<juce::AudioParameterBool*>(parameters.getParameter(getNormaliseParameterId(i)));
+        panParameters[i] = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter(getPanParameterId(i)));
+
+        auto& envelope = envelopeParameters[i];
+        envelope.attack = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter(getAttackParameterId(i)));
+        envelope.hold = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter(getHoldParameterId(i)));
+        envelope.decay = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter(getDecayParameterId(i)));
+        envelope.sustain = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter(getSustainParameterId(i)));
+        envelope.release = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter(getReleaseParameterId(i)));
+        envelope.noteOff = dynamic_cast<juce::AudioParameterBool*>(parameters.getParameter(getNoteOffParameterId(i)));
+    }
+
+    inputTriggerParameter = dynamic_cast<juce::AudioParameterBool*>(parameters.getParameter("input_trigger"));
+
+    micChannelGains.fill(1.0f);
+    renderScratch = createRenderScratch(1, 0);
+
+    parameters.state.setProperty("numPads", numPads.load(), nullptr);
 
     // Load samples if paths are specified
-    for (int i = 0; i < NUM_SOUNDS; ++i)
+    for (int i = 0; i < NUM_DEFAULT_SOUNDS; ++i)
     {
         if (samplePaths[i].isNotEmpty())
         {
@@ -52,10 +54,62 @@ DrumSimulatorAudioProcessor::DrumSimulatorAudioProcessor()
         }
     }
 
+    // Picks up background analysis results as they finish
+    startTimerHz(10);
 }
 
 DrumSimulatorAudioProcessor::~DrumSimulatorAudioProcessor()
 {
+    stopTimer();
+    stopCapture();
+}
+
+juce::AudioProcessorValueTreeState::ParameterLayout DrumSimulatorAudioProcessor::createParameterLayout()
+{
+    juce::AudioProcessorValueTreeState::ParameterLayout layout;
+
+    // Skewed so short times get most of the range
+    juce::NormalisableRange<float> timeRange(0.0f, 5000.0f, 0.0f, 0.3f);
+
+    for (int i = 0; i < maxPads; ++i)
+    {
+        auto name = getDefaultDrumName(i);
+        layout.add(std::make_unique<juce::AudioParameterFloat>(getGainParameterId(i), name + " Gain", 0.0f, 2.0f, 1.0f));
+        layout.add(std::make_unique<juce::AudioParameterBool>(getNormaliseParameterId(i), name + " Normalise", false));
+        layout.add(std::make_unique<juce::AudioParameterFloat>(getPanParameterId(i), name + " Pan", -1.0f, 1.0f, 0.0f));
+
+        // The defaults leave the sample untouched
+        layout.add(std::make_unique<juce::AudioParameterFloat>(getAttackParameterId(i), name + " Attack", timeRange, 0.0f));
+        layout.add(std::make_unique<juce::AudioParameterFloat>(getHoldParameterId(i), name + " Hold", timeRange, 0.0f));
+        layout.add(std::make_unique<juce::AudioParameterFloat>(getDecayParameterId(i), name + " Decay", timeRange, 0.0f));
+        layout.add(std::make_unique<juce::AudioParameterFloat>(getSustainParameterId(i), name + " Sustain", 0.0f, 1.0f, 1.0f));
+        layout.add(std::make_unique<juce::AudioParameterFloat>(getReleaseParameterId(i), name + " Release", timeRange, 100.0f));
+        layout.add(std::make_unique<juce::AudioParameterBool>(getNoteOffParameterId(i), name + " Note-Off Release", false));
+    }
+
+    layout.add(std::make_unique<juce::AudioParameterBool>("input_trigger", "Input Trigger", false));
+
+    return layout;
+}
+
+juce::String DrumSimulatorAudioProcessor::getParameterPrefix(int drumIndex)
+{
+    static const char* const defaultPrefixes[] = { "kick", "snare", "hihat", "crash", "tom1", "tom2", "tom3", "ride" };
+
+    if (drumIndex >= 0 && drumIndex < NUM_DEFAULT_SOUNDS)
+        return defaultPrefixes[drumIndex];
+
+    return "pad" + juce::String(drumIndex + 1);
+}
+
+juce::String DrumSimulatorAudioProcessor::getDefaultDrumName(int drumIndex)
+{
+    static const char* const defaultNames[] = { "Kick", "Snare", "Hi-Hat", "Crash", "Tom 1", "Tom 2", "Tom 3", "Ride" };
+
+    if (drumIndex >= 0 && drumIndex < NUM_DEFAULT_SOUNDS)
+        return defaultNames[drumIndex];
+
+    return "Pad " + juce::String(drumIndex + 1);
 }
 
 //==============================================================================
@@ -123,22 +177,35 @@ void DrumSimulatorAudioProcessor::changeProgramName(int index, const juce::Strin
 //==============================================================================
 void DrumSimulatorAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
-    // Prepare drum voices
-    for (auto& voice : drumVoices)
+    loadMeasurer.reset(sampleRate, samplesPerBlock);
+
+    // Workers' buses have to hold a whole block
+    auto newScratch = createRenderScratch((int)renderScratch.size(), samplesPerBlock);
     {
-        if (voice.resamplingSource)
-            voice.resamplingSource->prepareToPlay(samplesPerBlock, sampleRate);
+        const juce::SpinLock::ScopedLockType sl(voiceLock);
+        std::swap(renderScratch, newScratch);
+        numDelayedHits = 0;
+        renderedSamples = 0;
     }
+
+    // The detector never looks less than one hop ahead
+    inputTriggerLatency = juce::jmax(OnsetDetector::hopSize, juce::roundToInt(sampleRate * inputTriggerLookaheadMs / 1000.0));
+    for (auto& detector : onsetDetectors)
+        detector.prepare(sampleRate, inputTriggerLatency);
+
+    setLatencySamples(getInputTriggerLatency());
+
+    if (sampleRate == loadOptions.sampleRate)
+        return;
+
+    loadOptions.sampleRate = sampleRate;
+    reloadSamples();
 }
 
 void DrumSimulatorAudioProcessor::releaseResources()
 {
-    // Release resources
-    for (auto& voice : drumVoices)
-    {
-        if (voice.resamplingSource)
-            voice.resamplingSource->releaseResources();
-    }
+    // Samples stay in the shared pool until this instance is destroyed or
+    // loads something else
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -158,6 +225,11 @@ bool DrumSimulatorAudioProcessor::isBusesLayoutSupported(const BusesLayout& layo
 #if ! JucePlugin_IsSynth
     if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
         return false;
+#else
+    // The drum input is optional and only ever listened to
+    auto input = layouts.getMainInputChannelSet();
+    if (!input.isDisabled() && input != juce::AudioChannelSet::mono() && input != juce::AudioChannelSet::stereo())
+        return false;
 #endif
 
     return true;
@@ -171,15 +243,85 @@ void DrumSimulatorAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
-    // Clear any output channels that don't contain input data
-    for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
+    juce::AudioProcessLoadMeasurer::ScopedTimer renderTimer(loadMeasurer, buffer.getNumSamples());
+    auto renderStartTicks = juce::Time::getHighResolutionTicks();
+    const juce::SpinLock::ScopedLockType sl(voiceLock);
+
+    if (capture != nullptr)
+        capture->writeBlock(buffer, totalNumInputChannels, getSampleRate(), midiMessages);
+
+    // Listen for hits before the input is replaced by the drums
+    auto isInputTriggerOn = inputTriggerParameter->get() && totalNumInputChannels > 0;
+    detectInputTriggers(buffer, isInputTriggerOn ? totalNumInputChannels : 0);
+
+    // Clear any output channels that don't contain input data. The input is
+    // dropped altogether when it's being replaced, and synth builds never
+    // pass their drum input through.
+    auto firstChannelToClear = totalNumInputChannels;
+    if (isInputTriggerOn || JucePlugin_IsSynth)
+        firstChannelToClear = 0;
+
+    for (auto i = firstChannelToClear; i < totalNumOutputChannels; ++i)
         buffer.clear(i, 0, buffer.getNumSamples());
 
-    // Process MIDI events
-    processMidiEvents(midiMessages);
+    // Mix gains change at most once per block; pads starting later in the
+    // block get theirs when they're triggered
+    numOutputChannels = juce::jmin(totalNumOutputChannels, RoutingMatrix::maxOutputs);
+    for (int i = 0; i < voices.numActive; ++i)
+        updateRouting(voices.active[i]);
+
+    // Pads hit in the editor play from the top of the block and MIDI at its
+    // own position, both delayed by the latency reported for the input
+    // trigger (the timer tells the host the same value)
+    auto numSamples = buffer.getNumSamples();
+    auto blockStart = renderedSamples;
+    auto hitTime = blockStart + getInputTriggerLatency();
+    renderedSamples += numSamples;
+
+    processPendingTriggers(hitTime);
+
+    for (const auto metadata : midiMessages)
+        handleMidiEvent(metadata.getMessage(), hitTime + juce::jlimit(0, numSamples, metadata.samplePosition));
+
+    // Render up to each delayed hit or input hit before acting on it, so hits
+    // land on the exact sample whatever the host's block size is
+    int position = 0;
+    int nextInputTrigger = 0;
 
-    // Process drum voices
-    processDrumVoices(buffer);
+    auto renderUpTo = [&](int eventPosition)
+    {
+        for (; nextInputTrigger < numInputTriggers; ++nextInputTrigger)
+        {
+            const auto& trigger = inputTriggers[nextInputTrigger];
+            if (trigger.samplePosition > eventPosition)
+                break;
+
+            processDrumVoices(buffer, position, trigger.samplePosition - position);
+            position = trigger.samplePosition;
+            startVoice(trigger.drumIndex, trigger.velocity);
+        }
+
+        processDrumVoices(buffer, position, eventPosition - position);
+        position = eventPosition;
+    };
+
+    // Every delayed hit that falls due in this block, in time order
+    int numPlayed = 0;
+    for (; numPlayed < numDelayedHits && delayedHits[numPlayed].time < blockStart + numSamples; ++numPlayed)
+    {
+        const auto& hit = delayedHits[numPlayed];
+        renderUpTo(juce::jmax(position, (int)(hit.time - blockStart)));
+        playHit(hit);
+    }
+
+    std::copy(delayedHits.begin() + numPlayed, delayedHits.begin() + numDelayedHits, delayedHits.begin());
+    numDelayedHits -= numPlayed;
+
+    renderUpTo(numSamples);
+
+    if (capture != nullptr)
+        capture->writeRender(buffer, totalNumOutputChannels,
+            juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - renderStartTicks));
 }
 
 //==============================================================================
@@ -208,46 +350,46 @@ void DrumSimulatorAudioProcessor::setStateInformation(const void* data, int size
     if (xmlState.get() != nullptr)
         if (xmlState->hasTagName(parameters.state.getType()))
             parameters.replaceState(juce::ValueTree::fromXml(*xmlState));
+
+    setNumPads(parameters.state.getProperty("numPads", (int)NUM_DEFAULT_SOUNDS));
 }
 
 //==============================================================================
 void DrumSimulatorAudioProcessor::triggerDrum(int drumIndex, float velocity)
 {
-    if (drumIndex >= 0 && drumIndex < NUM_SOUNDS)
-    {
-        auto& voice = drumVoices[drumIndex];
-        if (voice.hasValidSample())
-        {
-            voice.trigger(velocity);
-            DBG("Triggered drum: " + voice.name + " with velocity: " + juce::String(velocity));
-        }
-        else
-        {
-            DBG("No sample loaded for drum: " + voice.name);
-        }
-    }
+    if (drumIndex < 0 || drumIndex >= getNumPads())
+        return;
+
+    // Voices belong to the audio thread, so hand the hit over to processBlock
+    const auto scope = pendingTriggerFifo.write(1);
+
+    if (scope.blockSize1 > 0)
+        pendingTriggers[scope.startIndex1] = { drumIndex, velocity };
+    else if (scope.blockSize2 > 0)
+        pendingTriggers[scope.startIndex2] = { drumIndex, velocity };
+    else
+        DBG("Trigger queue full, dropped hit for drum: " + drumSlots[drumIndex].name);
 }
 
 void DrumSimulatorAudioProcessor::loadSample(int drumIndex, const juce::File& file)
 {
-    if (drumIndex < 0 || drumIndex >= NUM_SOUNDS)
-        return;
+    loadSampleSlice(drumIndex, file, {});
+}
 
-    auto& voice = drumVoices[drumIndex];
+void DrumSimulatorAudioProcessor::loadSampleSlice(int drumIndex, const juce::File& file,
+    juce::Range<juce::int64> sourceRange)
+{
+    if (drumIndex < 0 || drumIndex >= maxPads)
+        return;
 
-    auto* reader = formatManager.createReaderFor(file);
+    // Identical files are decoded once and shared with every other drum and
+    // plugin instance that uses them
+    auto newSample = samplePool->getOrLoad(file, loadOptions);
 
-    if (reader != nullptr)
+    if (newSample != nullptr)
     {
-        // Load the entire sample into memory
-        voice.sampleBuffer.setSize((int)reader->numChannels, (int)reader->lengthInSamples);
-        reader->read(&voice.sampleBuffer, 0, (int)reader->lengthInSamples, 0, true, true);
-
-        // Create audio sources for real-time playback if needed
-        voice.readerSource = std::make_unique<juce::AudioFormatReaderSource>(reader, true);
-        voice.resamplingSource = std::make_unique<juce::ResamplingAudioSource>(voice.readerSource.get(), false);
-
-        DBG("Loaded sample: " + file.getFileName() + " for drum " + voice.name);
+        assignSample(drumIndex, newSample, file, sourceRange);
+        DBG("Loaded sample: " + file.getFileName() + " for drum " + drumSlots[drumIndex].name);
     }
     else
     {
@@ -255,94 +397,868 @@ void DrumSimulatorAudioProcessor::loadSample(int drumIndex, const juce::File& fi
     }
 }
 
+int DrumSimulatorAudioProcessor::loadSliceSheet(const juce::File& file, int firstDrumIndex, float thresholdDb)
+{
+    if (firstDrumIndex < 0 || firstDrumIndex >= maxPads)
+        return 0;
+
+    auto sheet = samplePool->getOrLoad(file, loadOptions);
+    if (sheet == nullptr)
+    {
+        DBG("Failed to load slice sheet: " + file.getFullPathName());
+        return 0;
+    }
+
+    auto slices = SamplePool::detectTransientSlices(sheet->getBuffer(), sheet->getSampleRate(), thresholdDb);
+    auto toSource = sheet->getSourceSampleRate() / sheet->getSampleRate();
+
+    int numAssigned = 0;
+    for (auto slice : slices)
+    {
+        auto drumIndex = firstDrumIndex + numAssigned;
+        if (drumIndex >= maxPads)
+            break;
+
+        auto start = slice.getStart() + sheet->getTrimmedStart();
+        auto end = slice.getEnd() + sheet->getTrimmedStart();
+        juce::Range<juce::int64> sourceRange((juce::int64)std::floor(start * toSource),
+            (juce::int64)std::ceil(end * toSource));
+
+        assignSample(drumIndex, sheet, file, sourceRange);
+        ++numAssigned;
+    }
+
+    DBG("Loaded " + juce::String(numAssigned) + " slices from " + file.getFileName());
+    return numAssigned;
+}
+
+void DrumSimulatorAudioProcessor::setSilenceTrim(float thresholdDb, double preRollMs)
+{
+    loadOptions.silenceThresholdDb = thresholdDb;
+    loadOptions.preRollMs = preRollMs;
+    reloadSamples();
+}
+
 bool DrumSimulatorAudioProcessor::isDrumLoaded(int drumIndex) const
 {
-    if (drumIndex >= 0 && drumIndex < NUM_SOUNDS)
-        return drumVoices[drumIndex].hasValidSample();
+    if (drumIndex >= 0 && drumIndex < maxPads)
+        return drumSlots[drumIndex].hasValidSample();
     return false;
 }
 
 juce::String DrumSimulatorAudioProcessor::getDrumName(int drumIndex) const
 {
-    if (drumIndex >= 0 && drumIndex < NUM_SOUNDS)
-        return drumVoices[drumIndex].name;
+    if (drumIndex >= 0 && drumIndex < maxPads)
+        return drumSlots[drumIndex].name;
     return {};
 }
 
+void DrumSimulatorAudioProcessor::setInputTriggerDrum(int inputChannel, int drumIndex)
+{
+    if (inputChannel < 0 || inputChannel >= maxTriggerInputs || drumIndex < 0 || drumIndex >= maxPads)
+        return;
+
+    const juce::SpinLock::ScopedLockType sl(voiceLock);
+    inputTriggerDrums[inputChannel] = drumIndex;
+}
+
+void DrumSimulatorAudioProcessor::setInputTriggerThresholdDb(float thresholdDb)
+{
+    const juce::SpinLock::ScopedLockType sl(voiceLock);
+    inputTriggerThresholdDb = thresholdDb;
+    for (auto& detector : onsetDetectors)
+        detector.setThresholdDb(thresholdDb);
+}
+
+void DrumSimulatorAudioProcessor::setMicChannelGain(int sampleChannel, float gain)
+{
+    if (sampleChannel < 0 || sampleChannel >= RoutingMatrix::maxInputs)
+        return;
+
+    const juce::SpinLock::ScopedLockType sl(voiceLock);
+    micChannelGains[sampleChannel] = gain;
+}
+
+void DrumSimulatorAudioProcessor::setMicSend(int drumIndex, int sampleChannel, float gain, float pan)
+{
+    if (drumIndex < 0 || drumIndex >= maxPads || sampleChannel < 0 || sampleChannel >= RoutingMatrix::maxInputs)
+        return;
+
+    const juce::SpinLock::ScopedLockType sl(voiceLock);
+    micSends[drumIndex][sampleChannel] = { gain, juce::jlimit(-1.0f, 1.0f, pan), true };
+}
+
+SampleAnalysis::Ptr DrumSimulatorAudioProcessor::getDrumAnalysis(int drumIndex) const
+{
+    if (drumIndex >= 0 && drumIndex < maxPads)
+        return drumSlots[drumIndex].analysis;
+    return nullptr;
+}
+
+void DrumSimulatorAudioProcessor::setNumPads(int newNumPads)
+{
+    newNumPads = juce::jlimit(1, maxPads, newNumPads);
+
+    {
+        const juce::SpinLock::ScopedLockType sl(voiceLock);
+
+        for (int i = newNumPads; i < maxPads; ++i)
+            voices.stop(i);
+
+        numPads = newNumPads;
+        updateNoteMap();
+    }
+
+    parameters.state.setProperty("numPads", newNumPads, nullptr);
+}
+
+int DrumSimulatorAudioProcessor::getMidiNote(int drumIndex) const
+{
+    if (drumIndex >= 0 && drumIndex < maxPads)
+        return drumSlots[drumIndex].midiNote;
+    return -1;
+}
+
+void DrumSimulatorAudioProcessor::setMidiNote(int drumIndex, int midiNote)
+{
+    if (drumIndex < 0 || drumIndex >= maxPads)
+        return;
+
+    const juce::SpinLock::ScopedLockType sl(voiceLock);
+    drumSlots[drumIndex].midiNote = juce::jlimit(-1, 127, midiNote);
+    updateNoteMap();
+}
+
 //==============================================================================
-void DrumSimulatorAudioProcessor::processDrumVoices(juce::AudioBuffer<float>& buffer)
+void DrumSimulatorAudioProcessor::processDrumVoices(juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
 {
-    auto numSamples = buffer.getNumSamples();
-    auto numChannels = buffer.getNumChannels();
+    auto numPartitions = (int)renderScratch.size();
+    auto shareOut = renderPool != nullptr
+        && voices.numActive >= numPartitions * minVoicesPerPartition
+        && numSamples >= minSamplesForPartitions
+        && numSamples <= renderScratch.back().bus.getNumSamples();
 
-    for (int drumIndex = 0; drumIndex < NUM_SOUNDS; ++drumIndex)
+    if (shareOut)
     {
-        auto& voice = drumVoices[drumIndex];
+        partitionOutput = &buffer;
+        partitionStart = startSample;
+        partitionLength = numSamples;
+        renderPool->run(*this);
 
-        if (!voice.isPlaying || !voice.hasValidSample())
-            continue;
+        // Sum the workers' buses into the output
+        for (int partition = 1; partition < numPartitions; ++partition)
+        {
+            const auto& bus = renderScratch[partition].bus;
+            for (int channel = 0; channel < numOutputChannels; ++channel)
+                juce::FloatVectorOperations::add(buffer.getWritePointer(channel, startSample),
+                    bus.getReadPointer(channel), numSamples);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < voices.numActive; ++i)
+            renderVoice(voices.active[i], buffer, startSample, numSamples, renderScratch.front());
+    }
+
+    // Finished voices are only retired once every partition is done with
+    // the active list. The rest keep their order, so the summing order never
+    // depends on which block a voice happened to finish in.
+    int numKept = 0;
+    for (int i = 0; i < voices.numActive; ++i)
+    {
+        auto drumIndex = voices.active[i];
+
+        if (voices.position[drumIndex] >= voices.end[drumIndex] || voices.stage[drumIndex] == EnvelopeStage::finished)
+            voices.playing[drumIndex] = false;
+        else
+            voices.active[numKept++] = drumIndex;
+    }
+
+    voices.numActive = numKept;
+}
+
+void DrumSimulatorAudioProcessor::renderPartition(int partition)
+{
+    auto& scratch = renderScratch[partition];
+    auto numPartitions = (int)renderScratch.size();
+
+    // Voices are dealt out in turn, which spreads long and short ones evenly
+    if (partition == 0)
+    {
+        for (int i = 0; i < voices.numActive; i += numPartitions)
+            renderVoice(voices.active[i], *partitionOutput, partitionStart, partitionLength, scratch);
+
+        return;
+    }
 
-        auto gain = gainParameters[drumIndex] ? gainParameters[drumIndex]->get() : 1.0f;
-        auto effectiveGain = gain * voice.velocity * voice.gain;
+    for (int channel = 0; channel < numOutputChannels; ++channel)
+        juce::FloatVectorOperations::clear(scratch.bus.getWritePointer(channel), partitionLength);
 
-        auto& sampleBuffer = voice.sampleBuffer;
-        auto sampleChannels = sampleBuffer.getNumChannels();
-        auto sampleLength = sampleBuffer.getNumSamples();
+    for (int i = partition; i < voices.numActive; i += numPartitions)
+        renderVoice(voices.active[i], scratch.bus, 0, partitionLength, scratch);
+}
+
+void DrumSimulatorAudioProcessor::renderVoice(int drumIndex, juce::AudioBuffer<float>& output, int outputStart,
+    int numSamples, RenderScratch& scratch)
+{
+    auto position = voices.position[drumIndex];
+    auto numToRender = juce::jmin(numSamples, voices.end[drumIndex] - position);
+    auto readPosition = voices.readStart[drumIndex] + position;
 
-        for (int sample = 0; sample < numSamples; ++sample)
+    // Render one straight envelope segment at a time
+    int rendered = 0;
+    while (rendered < numToRender && voices.stage[drumIndex] != EnvelopeStage::finished)
+    {
+        auto segment = juce::jmin(numToRender - rendered, voices.stageRemaining[drumIndex]);
+        mixVoiceSegment(drumIndex, output, outputStart + rendered, readPosition + rendered, segment, scratch);
+
+        rendered += segment;
+
+        if (voices.stage[drumIndex] != EnvelopeStage::sustain)
         {
-            if (voice.currentSampleIndex >= sampleLength)
+            voices.stageElapsed[drumIndex] += segment;
+            voices.stageRemaining[drumIndex] -= segment;
+            if (voices.stageRemaining[drumIndex] == 0)
+                voices.enterStage(drumIndex, (EnvelopeStage)((int)voices.stage[drumIndex] + 1));
+        }
+    }
+
+    voices.position[drumIndex] = position + rendered;
+}
+
+void DrumSimulatorAudioProcessor::mixVoiceSegment(int drumIndex, juce::AudioBuffer<float>& output, int outputStart,
+    int readPosition, int numSamples, RenderScratch& scratch)
+{
+    auto& matrix = routing[drumIndex];
+    auto& sampleBuffer = *voices.buffer[drumIndex];
+    auto hitGain = voices.gain[drumIndex];
+    auto levelStep = voices.levelStep[drumIndex];
+    auto elapsed = voices.stageElapsed[drumIndex];
+
+    // Multiply-add each sample channel into every output it reaches,
+    // skipping routes with no gain. A flat envelope is folded into the gain.
+    if (levelStep == 0.0f)
+    {
+        auto level = voices.level[drumIndex];
+
+        for (int input = 0; input < matrix.numInputs && level != 0.0f; ++input)
+        {
+            auto* source = sampleBuffer.getReadPointer(input, readPosition);
+
+            for (int channel = 0; channel < matrix.numOutputs; ++channel)
             {
-                voice.stop();
-                break;
+                auto routeGain = matrix.at(channel, input) * hitGain * level;
+                if (routeGain != 0.0f)
+                    juce::FloatVectorOperations::addWithMultiply(output.getWritePointer(channel, outputStart), source, routeGain, numSamples);
             }
+        }
+
+        return;
+    }
+
+    // Otherwise the ramp is written out and multiplied in a chunk at a time
+    constexpr auto chunkSize = RenderScratch::rampChunkSize;
+
+    for (int offset = 0; offset < numSamples; offset += chunkSize)
+    {
+        auto numInChunk = juce::jmin(chunkSize, numSamples - offset);
+
+        for (int j = 0; j < numInChunk; ++j)
+            scratch.envelopeRamp[j] = voices.getLevel(drumIndex, elapsed + offset + j);
+
+        for (int input = 0; input < matrix.numInputs; ++input)
+        {
+            juce::FloatVectorOperations::multiply(scratch.envelopedSamples.data(),
+                sampleBuffer.getReadPointer(input, readPosition + offset), scratch.envelopeRamp.data(), numInChunk);
 
-            for (int channel = 0; channel < numChannels; ++channel)
+            for (int channel = 0; channel < matrix.numOutputs; ++channel)
             {
-                auto sampleChannel = juce::jmin(channel, sampleChannels - 1);
-                auto sampleValue = sampleBuffer.getSample(sampleChannel, voice.currentSampleIndex) * effectiveGain;
-                buffer.addSample(channel, sample, sampleValue);
+                auto routeGain = matrix.at(channel, input) * hitGain;
+                if (routeGain != 0.0f)
+                    juce::FloatVectorOperations::addWithMultiply(output.getWritePointer(channel, outputStart + offset),
+                        scratch.envelopedSamples.data(), routeGain, numInChunk);
             }
+        }
+    }
+}
+
+std::vector<DrumSimulatorAudioProcessor::RenderScratch> DrumSimulatorAudioProcessor::createRenderScratch(int numThreads,
+    int blockSize)
+{
+    std::vector<RenderScratch> scratch((size_t)numThreads);
+
+    for (size_t i = 1; i < scratch.size(); ++i)
+        scratch[i].bus.setSize(RoutingMatrix::maxOutputs, juce::jmax(0, blockSize));
+
+    return scratch;
+}
+
+void DrumSimulatorAudioProcessor::setRenderThreads(int numThreads)
+{
+    // One core is always left for the host and everything else
+    auto maxThreads = juce::jlimit(1, maxRenderThreads, juce::SystemStats::getNumCpus() - 1);
+    numThreads = juce::jlimit(1, maxThreads, numThreads);
+
+    std::unique_ptr<VoiceRenderPool> newPool;
+    if (numThreads > 1)
+    {
+        newPool = std::make_unique<VoiceRenderPool>(numThreads - 1);
+
+        // Workers whose threads couldn't be started are left out of the pool
+        numThreads = newPool->getNumPartitions();
+        if (numThreads == 1)
+            newPool.reset();
+    }
+
+    auto newScratch = createRenderScratch(numThreads, getBlockSize());
+
+    {
+        const juce::SpinLock::ScopedLockType sl(voiceLock);
+        std::swap(renderPool, newPool);
+        std::swap(renderScratch, newScratch);
+    }
 
-            voice.currentSampleIndex++;
+    // The old pool's threads are stopped here, off the audio thread
+}
+
+void DrumSimulatorAudioProcessor::handleMidiEvent(const juce::MidiMessage& message, juce::int64 time)
+{
+    if (!message.isNoteOnOrOff())
+        return;
+
+    // Find which drum corresponds to this MIDI note
+    auto drumIndex = noteToDrum[message.getNoteNumber()];
+
+    if (drumIndex >= 0)
+        delayHit({ time, drumIndex, message.getFloatVelocity(), message.isNoteOff() });
+}
+
+void DrumSimulatorAudioProcessor::processPendingTriggers(juce::int64 time)
+{
+    pendingTriggerFifo.read(pendingTriggerFifo.getNumReady()).forEach([this, time](int index)
+        {
+            const auto& pending = pendingTriggers[index];
+            delayHit({ time, pending.drumIndex, pending.velocity, false });
+
+            if (capture != nullptr)
+                capture->writeTrigger(pending.drumIndex, pending.velocity);
+        });
+}
+
+void DrumSimulatorAudioProcessor::delayHit(const DelayedHit& hit)
+{
+    // A full queue drops the hit rather than allocating on the audio thread
+    if (numDelayedHits == (int)delayedHits.size())
+        return;
+
+    // Usually the latest hit yet, so this rarely moves anything
+    auto index = numDelayedHits;
+    for (; index > 0 && delayedHits[index - 1].time > hit.time; --index)
+        delayedHits[index] = delayedHits[index - 1];
+
+    delayedHits[index] = hit;
+    ++numDelayedHits;
+}
+
+void DrumSimulatorAudioProcessor::playHit(const DelayedHit& hit)
+{
+    auto drumIndex = hit.drumIndex;
+
+    // The pad may have been removed while the hit waited
+    if (!hit.isNoteOff)
+        startVoice(drumIndex, hit.velocity);
+    else if (drumIndex < getNumPads() && voices.playing[drumIndex] && voices.envelope[drumIndex].releaseOnNoteOff
+        && voices.stage[drumIndex] != EnvelopeStage::release)
+        voices.enterStage(drumIndex, EnvelopeStage::release);
+}
+
+int DrumSimulatorAudioProcessor::getInputTriggerLatency() const
+{
+    return inputTriggerParameter->get() && getTotalNumInputChannels() > 0 ? inputTriggerLatency : 0;
+}
+
+void DrumSimulatorAudioProcessor::detectInputTriggers(const juce::AudioBuffer<float>& buffer, int numInputChannels)
+{
+    numInputTriggers = 0;
+
+    auto isOn = numInputChannels > 0;
+    if (isOn != wasInputTriggerOn)
+    {
+        for (auto& detector : onsetDetectors)
+            detector.reset();
+
+        wasInputTriggerOn = isOn;
+    }
+
+    std::array<OnsetDetector::Onset, 16> onsets;
+    auto numChannels = juce::jmin(numInputChannels, maxTriggerInputs);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        auto numOnsets = onsetDetectors[channel].process(buffer.getReadPointer(channel), buffer.getNumSamples(),
+            onsets.data(), (int)onsets.size());
+
+        for (int i = 0; i < numOnsets && numInputTriggers < (int)inputTriggers.size(); ++i)
+            inputTriggers[numInputTriggers++] = { onsets[i].samplePosition, inputTriggerDrums[channel], onsets[i].velocity };
+    }
+
+    // Each channel's hits are already in order; only the merge needs sorting
+    if (numChannels > 1)
+        std::sort(inputTriggers.begin(), inputTriggers.begin() + numInputTriggers,
+            [](const InputTrigger& a, const InputTrigger& b) { return a.samplePosition < b.samplePosition; });
+}
+
+void DrumSimulatorAudioProcessor::startVoice(int drumIndex, float velocity)
+{
+    if (drumIndex < 0 || drumIndex >= getNumPads() || !drumSlots[drumIndex].hasValidSample())
+        return;
+
+    auto& slot = drumSlots[drumIndex];
+
+    // Loudness normalisation is folded into the hit's gain here rather than
+    // applied while rendering
+    auto hitGain = velocity * slot.gain;
+    if (normaliseParameters[drumIndex] != nullptr && normaliseParameters[drumIndex]->get())
+        hitGain *= slot.normalisationGain;
+
+    // Look up where this hit drops below the tail threshold at the gain it
+    // will actually be played with
+    auto gain = gainParameters[drumIndex] ? gainParameters[drumIndex]->get() : 1.0f;
+    gain *= getMaxMicGain(drumIndex, slot.sample->getBuffer().getNumChannels());
+    auto levelDb = tailThresholdDb.load() - juce::Decibels::gainToDecibels(gain * hitGain);
+
+    voices.start(drumIndex, &slot.sample->getBuffer(), slot.region.getStart(), slot.tail.getEndBelow(levelDb), hitGain,
+        getEnvelope(drumIndex));
+    updateRouting(drumIndex);
+}
+
+DrumSimulatorAudioProcessor::Envelope DrumSimulatorAudioProcessor::getEnvelope(int drumIndex) const
+{
+    const auto& params = envelopeParameters[drumIndex];
+    auto samplesPerMs = (loadOptions.sampleRate > 0.0 ? loadOptions.sampleRate : 44100.0) / 1000.0;
+
+    auto toSamples = [samplesPerMs](const juce::AudioParameterFloat* param)
+    {
+        return param != nullptr ? juce::roundToInt(param->get() * samplesPerMs) : 0;
+    };
+
+    Envelope envelope;
+    envelope.attack = toSamples(params.attack);
+    envelope.hold = toSamples(params.hold);
+    envelope.decay = toSamples(params.decay);
+    envelope.release = toSamples(params.release);
+    envelope.sustain = params.sustain != nullptr ? params.sustain->get() : 1.0f;
+    envelope.releaseOnNoteOff = params.noteOff != nullptr && params.noteOff->get();
+    return envelope;
+}
+
+void DrumSimulatorAudioProcessor::VoiceState::enterStage(int pad, EnvelopeStage newStage)
+{
+    const auto& settings = envelope[pad];
+    stage[pad] = newStage;
+
+    // Where the previous stage had got to, for a release to fall from
+    level[pad] = getLevel(pad, stageElapsed[pad]);
+    levelStep[pad] = 0.0f;
+    stageElapsed[pad] = 0;
+
+    switch (newStage)
+    {
+    case EnvelopeStage::attack:
+        if (settings.attack > 0)
+        {
+            level[pad] = 0.0f;
+            levelStep[pad] = 1.0f / (float)settings.attack;
+            stageRemaining[pad] = settings.attack;
+            return;
+        }
+        stage[pad] = EnvelopeStage::hold;
+        [[fallthrough]];
+
+    case EnvelopeStage::hold:
+        level[pad] = 1.0f;
+        if (settings.hold > 0)
+        {
+            stageRemaining[pad] = settings.hold;
+            return;
+        }
+        stage[pad] = EnvelopeStage::decay;
+        [[fallthrough]];
+
+    case EnvelopeStage::decay:
+        level[pad] = 1.0f;
+        if (settings.decay > 0)
+        {
+            levelStep[pad] = (settings.sustain - 1.0f) / (float)settings.decay;
+            stageRemaining[pad] = settings.decay;
+            return;
         }
+        stage[pad] = EnvelopeStage::sustain;
+        [[fallthrough]];
+
+    case EnvelopeStage::sustain:
+        // Lasts until note-off or the end of the sample
+        level[pad] = settings.sustain;
+        stageRemaining[pad] = std::numeric_limits<int>::max();
+        if (settings.sustain > 0.0f)
+            return;
+        break;
+
+    case EnvelopeStage::release:
+        // Falls from wherever the envelope had got to
+        if (settings.release > 0 && level[pad] > 0.0f)
+        {
+            levelStep[pad] = -level[pad] / (float)settings.release;
+            stageRemaining[pad] = settings.release;
+            return;
+        }
+        break;
+
+    case EnvelopeStage::finished:
+        break;
     }
+
+    stage[pad] = EnvelopeStage::finished;
+    level[pad] = 0.0f;
 }
 
-void DrumSimulatorAudioProcessor::processMidiEvents(const juce::MidiBuffer& midiMessages)
+void DrumSimulatorAudioProcessor::updateRouting(int drumIndex)
 {
-    for (const auto metadata : midiMessages)
+    auto& matrix = routing[drumIndex];
+    matrix.numOutputs = numOutputChannels;
+    matrix.numInputs = juce::jmin(voices.buffer[drumIndex]->getNumChannels(), RoutingMatrix::maxInputs);
+
+    auto gain = gainParameters[drumIndex] ? gainParameters[drumIndex]->get() : 1.0f;
+    auto pan = panParameters[drumIndex] ? panParameters[drumIndex]->get() : 0.0f;
+
+    // Balance-style pans, so anything centred plays at unity on both sides
+    auto balance = [](float position, int output)
     {
-        auto message = metadata.getMessage();
+        return output == 0 ? juce::jmin(1.0f, 1.0f - position) : juce::jmin(1.0f, 1.0f + position);
+    };
 
-        if (message.isNoteOn())
+    for (int input = 0; input < matrix.numInputs; ++input)
+    {
+        const auto& send = micSends[drumIndex][input];
+        auto micPan = send.hasPan ? send.pan : getDefaultMicPan(input, matrix.numInputs);
+        auto inputGain = gain * send.gain * micChannelGains[input];
+
+        if (matrix.numOutputs == 1)
         {
-            int midiNote = message.getNoteNumber();
-            float velocity = message.getFloatVelocity();
+            // A mono bus gets the average of the stereo mix's two sides, so a
+            // centred channel stays at unity and a left/right pair isn't
+            // summed at double the level
+            matrix.at(0, input) = inputGain * 0.5f
+                * (balance(micPan, 0) * balance(pan, 0) + balance(micPan, 1) * balance(pan, 1));
+            continue;
+        }
 
-            // Find which drum corresponds to this MIDI note
-            for (int i = 0; i < NUM_SOUNDS; ++i)
-            {
-                if (midiNoteMapping[i] == midiNote)
-                {
-                    triggerDrum(i, velocity);
-                    break;
-                }
-            }
+        for (int output = 0; output < matrix.numOutputs; ++output)
+            matrix.at(output, input) = inputGain * balance(micPan, output) * balance(pan, output);
+    }
+}
+
+float DrumSimulatorAudioProcessor::getDefaultMicPan(int sampleChannel, int numSampleChannels)
+{
+    // With an odd channel count the first is a centred close mic; the rest
+    // are overhead/room pairs
+    auto numCentred = numSampleChannels % 2;
+    if (sampleChannel < numCentred)
+        return 0.0f;
+
+    return (sampleChannel - numCentred) % 2 == 0 ? -1.0f : 1.0f;
+}
+
+float DrumSimulatorAudioProcessor::getMaxMicGain(int drumIndex, int numSampleChannels) const
+{
+    auto maxGain = 0.0f;
+    for (int input = 0; input < juce::jmin(numSampleChannels, RoutingMatrix::maxInputs); ++input)
+        maxGain = juce::jmax(maxGain, std::abs(micChannelGains[input] * micSends[drumIndex][input].gain));
+
+    return maxGain;
+}
+
+void DrumSimulatorAudioProcessor::setupDrumSlots()
+{
+    for (int i = 0; i < maxPads; ++i)
+    {
+        auto& slot = drumSlots[i];
+        slot.name = getDefaultDrumName(i).toUpperCase();
+        slot.midiNote = i < NUM_DEFAULT_SOUNDS ? defaultMidiNotes[i] : juce::jmin(127, 60 + i - NUM_DEFAULT_SOUNDS);
+    }
+
+    updateNoteMap();
+}
+
+void DrumSimulatorAudioProcessor::updateNoteMap()
+{
+    noteToDrum.fill(-1);
+
+    // Lower pads win if two share a note
+    for (int i = getNumPads(); --i >= 0;)
+        if (drumSlots[i].midiNote >= 0)
+            noteToDrum[drumSlots[i].midiNote] = i;
+}
+
+void DrumSimulatorAudioProcessor::reloadSamples()
+{
+    // Fetch every loaded sample with the current options; the pool only
+    // decodes files no other instance has already prepared the same way
+    for (int i = 0; i < maxPads; ++i)
+    {
+        auto& slot = drumSlots[i];
+        if (slot.sample != nullptr)
+        {
+            auto file = slot.sourceFile;
+            loadSampleSlice(i, file, slot.sourceRange);
+        }
+    }
+}
+
+void DrumSimulatorAudioProcessor::assignSample(int drumIndex, SharedSample::Ptr newSample,
+    const juce::File& file, juce::Range<juce::int64> sourceRange)
+{
+    auto& slot = drumSlots[drumIndex];
+
+    // Map the slice from file positions onto the (possibly resampled and
+    // trimmed) buffer
+    auto bufferLength = newSample->getBuffer().getNumSamples();
+    juce::Range<int> region(0, bufferLength);
+
+    if (!sourceRange.isEmpty())
+    {
+        auto toBuffer = newSample->getSampleRate() / newSample->getSourceSampleRate();
+        auto offset = newSample->getTrimmedStart();
+        region = juce::Range<int>((int)std::floor(sourceRange.getStart() * toBuffer) - offset,
+            (int)std::ceil(sourceRange.getEnd() * toBuffer) - offset).getIntersectionWith(region);
+    }
+
+    TailTable tail;
+    tail.compute(newSample->getBuffer(), region);
+
+    {
+        const juce::SpinLock::ScopedLockType sl(voiceLock);
+        voices.stop(drumIndex);
+        std::swap(slot.sample, newSample);
+        slot.sourceFile = file;
+        slot.sourceRange = sourceRange;
+        slot.region = region;
+        slot.tail = tail;
+        slot.analysis = nullptr;
+        slot.normalisationGain = 1.0f;
+    }
+
+    // The previous sample is released here, on the message thread; the pool
+    // frees it later once no instance uses it any more
+    newSample = nullptr;
+
+    samplePool->requestAnalysis(slot.sample, region);
+}
+
+bool DrumSimulatorAudioProcessor::startCapture(const juce::File& file)
+{
+    stopCapture();
+
+    auto stream = file.createOutputStream();
+    if (stream == nullptr)
+    {
+        DBG("Couldn't open capture file: " + file.getFullPathName());
+        return false;
+    }
+
+    stream->setPosition(0);
+    stream->truncate();
+    writeCaptureHeader(*stream);
+
+    auto newCapture = std::make_unique<BlockCapture>(std::move(stream), getParameters());
+
+    {
+        const juce::SpinLock::ScopedLockType sl(voiceLock);
+
+        // A fresh processor in the replay has nothing playing yet either
+        while (voices.numActive > 0)
+            voices.retire(0);
+
+        numDelayedHits = 0;
+
+        for (auto& detector : onsetDetectors)
+            detector.reset();
+
+        wasInputTriggerOn = false;
+        std::swap(capture, newCapture);
+    }
+
+    return true;
+}
+
+void DrumSimulatorAudioProcessor::stopCapture()
+{
+    std::unique_ptr<BlockCapture> oldCapture;
+
+    {
+        const juce::SpinLock::ScopedLockType sl(voiceLock);
+        std::swap(capture, oldCapture);
+    }
+
+    // Deleting it here, off the audio thread, writes out whatever is left
+}
+
+void DrumSimulatorAudioProcessor::writeCaptureHeader(juce::OutputStream& output)
+{
+    output.writeInt((int)BlockCapture::fileMagic);
+    output.writeInt((int)BlockCapture::fileVersion);
+
+    output.writeDouble(getSampleRate());
+    output.writeInt(getBlockSize());
+    output.writeInt(getTotalNumInputChannels());
+    output.writeInt(getTotalNumOutputChannels());
+
+    // Parameters are logged exactly in the first block; the state carries
+    // the rest, such as the kit size
+    juce::MemoryBlock state;
+    getStateInformation(state);
+    output.writeInt((int)state.getSize());
+    output.write(state.getData(), state.getSize());
+
+    output.writeFloat(loadOptions.silenceThresholdDb);
+    output.writeDouble(loadOptions.preRollMs);
+    output.writeFloat(tailThresholdDb.load());
+    output.writeFloat(inputTriggerThresholdDb);
+
+    for (auto gain : micChannelGains)
+        output.writeFloat(gain);
+
+    for (const auto& padSends : micSends)
+    {
+        for (const auto& send : padSends)
+        {
+            output.writeFloat(send.gain);
+            output.writeFloat(send.pan);
+            output.writeBool(send.hasPan);
+        }
+    }
+
+    for (auto drumIndex : inputTriggerDrums)
+        output.writeInt(drumIndex);
+
+    output.writeInt(getRenderThreads());
+
+    for (const auto& slot : drumSlots)
+    {
+        output.writeInt(slot.midiNote);
+        output.writeBool(slot.sample != nullptr);
+
+        if (slot.sample != nullptr)
+        {
+            output.writeString(slot.sourceFile.getFullPathName());
+            output.writeInt64(slot.sourceRange.getStart());
+            output.writeInt64(slot.sourceRange.getEnd());
+            output.writeInt64((juce::int64)slot.sample->getContentHash());
+            output.writeFloat(slot.normalisationGain);
+        }
+    }
+}
+
+bool DrumSimulatorAudioProcessor::restoreCaptureHeader(juce::InputStream& input)
+{
+    if (input.readInt() != (int)BlockCapture::fileMagic || input.readInt() != (int)BlockCapture::fileVersion)
+        return false;
+
+    auto sampleRate = input.readDouble();
+    auto blockSize = input.readInt();
+    auto numInputChannels = input.readInt();
+    auto numOutputChannels = input.readInt();
+
+    juce::MemoryBlock state;
+    input.readIntoMemoryBlock(state, input.readInt());
+    setStateInformation(state.getData(), (int)state.getSize());
+
+    loadOptions.silenceThresholdDb = input.readFloat();
+    loadOptions.preRollMs = input.readDouble();
+    tailThresholdDb = input.readFloat();
+    setInputTriggerThresholdDb(input.readFloat());
+
+    for (auto& gain : micChannelGains)
+        gain = input.readFloat();
+
+    for (auto& padSends : micSends)
+    {
+        for (auto& send : padSends)
+        {
+            send.gain = input.readFloat();
+            send.pan = input.readFloat();
+            send.hasPan = input.readBool();
+        }
+    }
+
+    // A corrupt file mustn't be able to point a trigger outside the pads
+    for (int channel = 0; channel < maxTriggerInputs; ++channel)
+    {
+        auto drumIndex = input.readInt();
+        if (drumIndex < 0 || drumIndex >= maxPads)
+            return false;
+
+        setInputTriggerDrum(channel, drumIndex);
+    }
+
+    auto numRenderThreads = input.readInt();
+
+    // Samples are decoded at the captured rate, as they were live
+    setPlayConfigDetails(numInputChannels, numOutputChannels, sampleRate, blockSize);
+    prepareToPlay(sampleRate, blockSize);
+
+    // Voices are summed in a different order when they're split across
+    // threads, so the output only matches bit for bit with the same count
+    setRenderThreads(numRenderThreads);
+
+    for (int i = 0; i < maxPads; ++i)
+    {
+        setMidiNote(i, input.readInt());
+
+        if (!input.readBool())
+            continue;
+
+        juce::File file(input.readString());
+        auto start = input.readInt64();
+        juce::Range<juce::int64> sourceRange(start, input.readInt64());
+        auto contentHash = (juce::uint64)input.readInt64();
+        auto normalisationGain = input.readFloat();
+
+        loadSampleSlice(i, file, sourceRange);
+
+        auto& slot = drumSlots[i];
+        if (slot.sample == nullptr || slot.sample->getContentHash() != contentHash)
+        {
+            DBG("Captured sample is missing or has changed: " + file.getFullPathName());
+            return false;
         }
+
+        // Taken as captured, rather than waiting for the analysis to rerun
+        slot.normalisationGain = normalisationGain;
     }
+
+    return true;
 }
 
-void DrumSimulatorAudioProcessor::setupDrumNames()
+void DrumSimulatorAudioProcessor::timerCallback()
 {
-    drumVoices[KICK].name = "KICK";
-    drumVoices[SNARE].name = "SNARE";
-    drumVoices[HIHAT].name = "HI-HAT";
-    drumVoices[CRASH].name = "CRASH";
-    drumVoices[TOM1].name = "TOM 1";
-    drumVoices[TOM2].name = "TOM 2";
-    drumVoices[TOM3].name = "TOM 3";
-    drumVoices[RIDE].name = "RIDE";
+    // Latency changes are reported from here rather than the audio thread
+    auto latency = getInputTriggerLatency();
+    if (latency != getLatencySamples())
+        setLatencySamples(latency);
+
+    for (auto& slot : drumSlots)
+    {
+        if (slot.analysis != nullptr || !slot.hasValidSample())
+            continue;
+
+        if (auto analysis = slot.sample->findAnalysis(slot.region))
+        {
+            const juce::SpinLock::ScopedLockType sl(voiceLock);
+            slot.analysis = analysis;
+            slot.normalisationGain = analysis->getNormalisationGain(normalisationTargetLufs);
+        }
+    }
 }
 
 //==============================================================================
@@ -1,10 +1,16 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "SamplePool.h"
+#include "OnsetDetector.h"
+#include "BlockCapture.h"
+#include "VoiceRenderPool.h"
 
 //==============================================================================
 class DrumSimulatorAudioProcessor : public juce::AudioProcessor,
-    public juce::ValueTree::Listener
+    public juce::ValueTree::Listener,
+    private juce::Timer,
+    private VoiceRenderPool::Job
 {
 public:
     //==============================================================================
@@ -49,9 +55,116 @@ public:
     // Custom methods for drum functionality
     void triggerDrum(int drumIndex, float velocity = 1.0f);
     void loadSample(int drumIndex, const juce::File& file);
+
+    // Plays only part of a file, given in the file's own sample positions.
+    // Slices of the same file all point into one shared decoded buffer.
+    void loadSampleSlice(int drumIndex, const juce::File& file, juce::Range<juce::int64> sourceRange);
+
+    // Splits a kit recorded as consecutive hits at its transients and assigns
+    // the slices to drums starting at firstDrumIndex. Returns the number assigned.
+    int loadSliceSheet(const juce::File& file, int firstDrumIndex, float thresholdDb = -30.0f);
+
+    // Leading and trailing audio below thresholdDb is removed when samples are
+    // decoded, keeping preRollMs ahead of the first audible sample
+    void setSilenceTrim(float thresholdDb, double preRollMs);
+
+    // Voices stop once the rest of their tail, at the gain they were
+    // triggered with, stays below this output level
+    void setTailThresholdDb(float thresholdDb) { tailThresholdDb = thresholdDb; }
+
+    // Prefaults and locks sample memory in RAM on a background thread, for
+    // every instance in the process. Locked memory counts against budgetBytes.
+    void setSampleMemoryLocking(SamplePool::MemoryLockMode mode, double attackMs, size_t budgetBytes)
+    {
+        samplePool->setMemoryLocking(mode, attackMs, budgetBytes);
+    }
+
+    size_t getLockedSampleBytes() const { return samplePool->getLockedBytes(); }
+    int getSampleLockFailures() const { return samplePool->getLockFailures(); }
+
+    // Drum replacement: with the "input_trigger" parameter on, hits detected
+    // on each audio input channel play that channel's drum in place of the
+    // input. Detection looks inputTriggerLookaheadMs ahead to measure each
+    // hit's level, and that delay is reported to the host as latency. MIDI
+    // notes and editor hits are held back by the same amount so they stay
+    // in time with the input once the host compensates.
+    void setInputTriggerDrum(int inputChannel, int drumIndex);
+    void setInputTriggerThresholdDb(float thresholdDb);
+
+    static constexpr int maxTriggerInputs = 2;
+    static constexpr double inputTriggerLookaheadMs = 1.5;
+
     bool isDrumLoaded(int drumIndex) const;
     juce::String getDrumName(int drumIndex) const;
 
+    // Thumbnail and levels of the drum's sample, or nullptr while the
+    // background analysis is still running
+    SampleAnalysis::Ptr getDrumAnalysis(int drumIndex) const;
+
+    // How many blocks took longer to render than their real-time duration,
+    // for checking against a performance budget
+    int getRenderOverruns() const { return loadMeasurer.getXRunCount(); }
+
+    // Shares voice rendering between the audio thread and numThreads - 1
+    // realtime workers; 1 keeps it all on the audio thread. Segments with
+    // too few voices to repay waking the workers are still rendered there.
+    // Voices are summed in a different order, so the output can differ from
+    // single-threaded rendering in the lowest bits. At most one thread fewer
+    // than there are cores is used.
+    void setRenderThreads(int numThreads);
+    int getRenderThreads() const { return (int)renderScratch.size(); }
+
+    static constexpr int maxRenderThreads = 8;
+
+    // Logs every block to a file that Tools/CaptureReplay can play back
+    // through a fresh processor, bit for bit. Playing voices are cut when the
+    // capture starts so the replay begins from the same state. Sample loads
+    // and note changes made during a capture aren't recorded.
+    bool startCapture(const juce::File& file);
+    void stopCapture();
+    bool isCapturing() const { return capture != nullptr; }
+    bool hasCaptureOverflowed() const { return capture != nullptr && capture->hasOverflowed(); }
+
+    //==============================================================================
+    // Kit size. Parameters exist for all maxPads pads so hosts see a fixed
+    // list; only the first getNumPads() respond to MIDI and are shown.
+    int getNumPads() const noexcept { return numPads.load(); }
+    void setNumPads(int newNumPads);
+
+    int getMidiNote(int drumIndex) const;
+    void setMidiNote(int drumIndex, int midiNote);
+
+    // Parameter IDs are "<prefix>_gain" etc. The first eight pads keep the
+    // original kit's prefixes ("kick", "snare"...) so old sessions still load.
+    static juce::String getParameterPrefix(int drumIndex);
+    static juce::String getGainParameterId(int drumIndex) { return getParameterPrefix(drumIndex) + "_gain"; }
+    static juce::String getNormaliseParameterId(int drumIndex) { return getParameterPrefix(drumIndex) + "_normalise"; }
+    static juce::String getPanParameterId(int drumIndex) { return getParameterPrefix(drumIndex) + "_pan"; }
+
+    // Amplitude envelope: attack, hold and decay times in ms, the sustain
+    // level, and a release that runs on note-off when "_noteoff" is on.
+    // Without note-offs a hit sustains until the sample ends.
+    static juce::String getAttackParameterId(int drumIndex) { return getParameterPrefix(drumIndex) + "_attack"; }
+    static juce::String getHoldParameterId(int drumIndex) { return getParameterPrefix(drumIndex) + "_hold"; }
+    static juce::String getDecayParameterId(int drumIndex) { return getParameterPrefix(drumIndex) + "_decay"; }
+    static juce::String getSustainParameterId(int drumIndex) { return getParameterPrefix(drumIndex) + "_sustain"; }
+    static juce::String getReleaseParameterId(int drumIndex) { return getParameterPrefix(drumIndex) + "_release"; }
+    static juce::String getNoteOffParameterId(int drumIndex) { return getParameterPrefix(drumIndex) + "_noteoff"; }
+
+    // Level of one sample channel (e.g. a close, overhead or room mic) in
+    // every pad's mix
+    void setMicChannelGain(int sampleChannel, float gain);
+
+    // Level and pan (-1 to 1) of one sample channel in a single pad's mix, on
+    // top of the kit-wide mic gain. Until a pan is set, mono samples sit in
+    // the centre; otherwise an odd first channel (the close mic) is centred
+    // and the rest are taken as left/right pairs. A mono output gets the
+    // average of the two sides.
+    void setMicSend(int drumIndex, int sampleChannel, float gain, float pan);
+
+    // Loudness that pads with normalisation switched on are brought to
+    static constexpr float normalisationTargetLufs = -18.0f;
+
     //==============================================================================
     // ValueTree::Listener
     void valueTreePropertyChanged(juce::ValueTree&, const juce::Identifier&) override {}
@@ -66,52 +179,280 @@ public:
         TOM2,
         TOM3,
         RIDE,
-        NUM_SOUNDS
+        NUM_DEFAULT_SOUNDS
     };
 
+    static constexpr int maxPads = 64;
+
 private:
+    friend class CaptureReplay;
+
     //==============================================================================
-    struct DrumVoice
+    // Everything loaded for one pad. Changed on the message thread under
+    // voiceLock and read by the audio thread while rendering.
+    struct DrumSlot
     {
-        std::unique_ptr<juce::AudioFormatReaderSource> readerSource;
-        std::unique_ptr<juce::ResamplingAudioSource> resamplingSource;
-        juce::AudioBuffer<float> sampleBuffer;
-        int currentSampleIndex = 0;
-        bool isPlaying = false;
-        float velocity = 1.0f;
+        SharedSample::Ptr sample;
+        juce::File sourceFile;
+        juce::Range<juce::int64> sourceRange; // empty means the whole file
+        juce::Range<int> region;              // playable part of sample's buffer
+        TailTable tail;
+        SampleAnalysis::Ptr analysis;
+        float normalisationGain = 1.0f;
         float gain = 1.0f;
+        int midiNote = -1;
         juce::String name;
 
-        void trigger(float vel)
+        bool hasValidSample() const
+        {
+            return sample != nullptr && !region.isEmpty();
+        }
+    };
+
+    // A pad's envelope settings, converted to samples when it's hit
+    struct Envelope
+    {
+        int attack = 0;
+        int hold = 0;
+        int decay = 0;
+        int release = 0;
+        float sustain = 1.0f;
+        bool releaseOnNoteOff = false;
+    };
+
+    enum class EnvelopeStage
+    {
+        attack,
+        hold,
+        decay,
+        sustain,
+        release,
+        finished
+    };
+
+    // Playback state of every pad as parallel arrays, so the render loop
+    // walks contiguous memory whatever the kit size. Owned by the audio thread.
+    struct VoiceState
+    {
+        std::array<const juce::AudioBuffer<float>*, maxPads> buffer {};
+        std::array<int, maxPads> readStart {};  // region start within buffer
+        std::array<int, maxPads> position {};   // samples played so far
+        std::array<int, maxPads> end {};        // where this hit becomes inaudible
+        std::array<float, maxPads> gain {};     // velocity and fixed pad gains; the parameter is applied per block
+        std::array<bool, maxPads> playing {};
+
+        // The envelope moves in straight lines between stages, so each block
+        // renders a few linear segments rather than evaluating it per sample
+        std::array<Envelope, maxPads> envelope {};
+        std::array<EnvelopeStage, maxPads> stage {};
+        std::array<float, maxPads> level {};          // at the start of the stage
+        std::array<float, maxPads> levelStep {};      // per sample, within the stage
+        std::array<int, maxPads> stageElapsed {};     // samples played in the stage
+        std::array<int, maxPads> stageRemaining {};   // samples left in the stage
+
+        // Indices of the playing pads, densely packed in the order they
+        // started. Voices are summed in this order, so it's kept stable.
+        std::array<int, maxPads> active {};
+        int numActive = 0;
+
+        void start(int pad, const juce::AudioBuffer<float>* source, int regionStart, int endIndex, float hitGain,
+            const Envelope& hitEnvelope)
         {
-            velocity = vel;
-            currentSampleIndex = 0;
-            isPlaying = true;
+            buffer[pad] = source;
+            readStart[pad] = regionStart;
+            position[pad] = 0;
+            end[pad] = endIndex;
+            gain[pad] = hitGain;
+            envelope[pad] = hitEnvelope;
+            level[pad] = 0.0f;
+            levelStep[pad] = 0.0f;
+            stageElapsed[pad] = 0;
+            enterStage(pad, EnvelopeStage::attack);
+
+            if (!playing[pad])
+            {
+                playing[pad] = true;
+                active[numActive++] = pad;
+            }
         }
 
-        void stop()
+        // Removes the voice at this position in the active list
+        void retire(int activeIndex)
         {
-            isPlaying = false;
-            currentSampleIndex = 0;
+            playing[active[activeIndex]] = false;
+            std::copy(active.begin() + activeIndex + 1, active.begin() + numActive, active.begin() + activeIndex);
+            --numActive;
         }
 
-        bool hasValidSample() const
+        // Stages of zero length are skipped straight through
+        void enterStage(int pad, EnvelopeStage newStage);
+
+        // Worked out from the stage's start rather than accumulated, so it
+        // doesn't depend on where blocks and events split the stage
+        float getLevel(int pad, int samplesIntoStage) const noexcept
+        {
+            return level[pad] + levelStep[pad] * (float)samplesIntoStage;
+        }
+
+        void stop(int pad)
         {
-            return sampleBuffer.getNumSamples() > 0;
+            for (int i = 0; i < numActive; ++i)
+            {
+                if (active[i] == pad)
+                {
+                    retire(i);
+                    return;
+                }
+            }
         }
     };
 
+    // Gains from each sample channel to each output for one pad
+    struct RoutingMatrix
+    {
+        static constexpr int maxOutputs = 8;
+        static constexpr int maxInputs = 8;
+
+        float& at(int output, int input) { return gains[output * maxInputs + input]; }
+
+        std::array<float, maxOutputs * maxInputs> gains {};
+        int numOutputs = 0;
+        int numInputs = 0;
+    };
+
+    // Per-thread working space for rendering voices
+    struct RenderScratch
+    {
+        // Envelope ramps are applied this many samples at a time
+        static constexpr int rampChunkSize = 256;
+
+        std::array<float, rampChunkSize> envelopeRamp;
+        std::array<float, rampChunkSize> envelopedSamples;
+
+        // Workers mix into this, and it's added to the output afterwards.
+        // Unused by the audio thread, which mixes straight into the output.
+        juce::AudioBuffer<float> bus;
+    };
+
     //==============================================================================
-    void processDrumVoices(juce::AudioBuffer<float>& buffer);
-    void processMidiEvents(const juce::MidiBuffer& midiMessages);
-    void setupDrumNames();
+    void timerCallback() override;
+    void renderPartition(int partition) override;
+
+    static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
+    static juce::String getDefaultDrumName(int drumIndex);
+
+    void processDrumVoices(juce::AudioBuffer<float>& buffer, int startSample, int numSamples);
+    void renderVoice(int drumIndex, juce::AudioBuffer<float>& output, int outputStart, int numSamples,
+        RenderScratch& scratch);
+    void mixVoiceSegment(int drumIndex, juce::AudioBuffer<float>& output, int outputStart, int readPosition,
+        int numSamples, RenderScratch& scratch);
+    static std::vector<RenderScratch> createRenderScratch(int numThreads, int blockSize);
+    struct DelayedHit;
+    void handleMidiEvent(const juce::MidiMessage& message, juce::int64 time);
+    void processPendingTriggers(juce::int64 time);
+    void delayHit(const DelayedHit& hit);
+    void playHit(const DelayedHit& hit);
+    int getInputTriggerLatency() const;
+    void detectInputTriggers(const juce::AudioBuffer<float>& buffer, int numInputChannels);
+    void startVoice(int drumIndex, float velocity);
+    Envelope getEnvelope(int drumIndex) const;
+    void updateRouting(int drumIndex);
+    static float getDefaultMicPan(int sampleChannel, int numSampleChannels);
+    float getMaxMicGain(int drumIndex, int numSampleChannels) const;
+    void setupDrumSlots();
+    void updateNoteMap();
+    void reloadSamples();
+    void assignSample(int drumIndex, SharedSample::Ptr newSample, const juce::File& file,
+        juce::Range<juce::int64> sourceRange);
+
+    // Everything a replay needs to rebuild this processor's setup
+    void writeCaptureHeader(juce::OutputStream& output);
+    bool restoreCaptureHeader(juce::InputStream& input);
 
     //==============================================================================
-    std::array<DrumVoice, NUM_SOUNDS> drumVoices;
-    juce::AudioFormatManager formatManager;
+    std::array<DrumSlot, maxPads> drumSlots;
+    VoiceState voices;
+
+    // One scratch per render thread, the audio thread's first. Swapped in
+    // with the pool under voiceLock.
+    std::vector<RenderScratch> renderScratch;
+    std::unique_ptr<VoiceRenderPool> renderPool;
+
+    // Voices per thread below which a segment stays on the audio thread
+    static constexpr int minVoicesPerPartition = 4;
+    static constexpr int minSamplesForPartitions = 16;
+
+    // The segment being shared out by processDrumVoices
+    juce::AudioBuffer<float>* partitionOutput = nullptr;
+    int partitionStart = 0;
+    int partitionLength = 0;
+    std::array<RoutingMatrix, maxPads> routing;
+    std::array<float, RoutingMatrix::maxInputs> micChannelGains;
+
+    struct MicSend
+    {
+        float gain = 1.0f;
+        float pan = 0.0f;
+        bool hasPan = false; // otherwise the layout default is used
+    };
+
+    std::array<std::array<MicSend, RoutingMatrix::maxInputs>, maxPads> micSends;
+    int numOutputChannels = 2;
+    std::atomic<int> numPads { NUM_DEFAULT_SOUNDS };
+    juce::SharedResourcePointer<SamplePool> samplePool;
 
-    // MIDI note mappings for drum sounds
-    std::array<int, NUM_SOUNDS> midiNoteMapping = {
+    // Guards drumSlots, voices and noteToDrum; held by the audio thread while
+    // rendering and by the message thread only for short updates
+    juce::SpinLock voiceLock;
+    SampleLoadOptions loadOptions;
+    juce::AudioProcessLoadMeasurer loadMeasurer;
+
+    // Swapped in and out under voiceLock
+    std::unique_ptr<BlockCapture> capture;
+
+    // Hits from the editor, queued until the next block
+    struct PendingTrigger
+    {
+        int drumIndex = 0;
+        float velocity = 1.0f;
+    };
+
+    juce::AbstractFifo pendingTriggerFifo { 64 };
+    std::array<PendingTrigger, 64> pendingTriggers;
+    std::atomic<float> tailThresholdDb { -80.0f };
+
+    // Hits found in the audio input this block, in time order
+    struct InputTrigger
+    {
+        int samplePosition = 0;
+        int drumIndex = 0;
+        float velocity = 1.0f;
+    };
+
+    std::array<OnsetDetector, maxTriggerInputs> onsetDetectors;
+    std::array<int, maxTriggerInputs> inputTriggerDrums { KICK, SNARE };
+    std::array<InputTrigger, 64> inputTriggers;
+    int numInputTriggers = 0;
+    float inputTriggerThresholdDb = -30.0f;
+    int inputTriggerLatency = 0;
+    bool wasInputTriggerOn = false;
+
+    // MIDI notes and editor hits waiting out the input trigger latency, in
+    // time order. Times count samples since prepareToPlay.
+    struct DelayedHit
+    {
+        juce::int64 time = 0;
+        int drumIndex = 0;
+        float velocity = 1.0f;
+        bool isNoteOff = false;
+    };
+
+    std::array<DelayedHit, 512> delayedHits;
+    int numDelayedHits = 0;
+    juce::int64 renderedSamples = 0;
+
+    // MIDI note mappings for the default kit; further pads count up from C3
+    std::array<int, NUM_DEFAULT_SOUNDS> defaultMidiNotes = {
         36, // KICK (C1)
         38, // SNARE (D1)
         42, // HIHAT (F#1)
@@ -122,9 +463,12 @@ private:
         51  // RIDE (D#2)
     };
 
+    // Drum index for each MIDI note, or -1
+    std::array<int, 128> noteToDrum;
+
     // ***** ADD YOUR SAMPLE PATHS HERE *****
     // Replace these empty strings with paths to your drum samples
-    std::array<juce::String, NUM_SOUNDS> samplePaths = {
+    std::array<juce::String, NUM_DEFAULT_SOUNDS> samplePaths = {
         "E:\\JUCE\\Programs\\XZ Beats\\Kick Samples\\Kick 3.wav", // KICK - Add path to kick drum sample here (e.g., "C:/Samples/kick.wav")
         "E:\\JUCE\\Programs\\XZ Beats\\SnareSamples\\Snare 5.wav", // SNARE - Add path to snare drum sample here
         "E:\\JUCE\\Programs\\XZ Beats\\high-hat\\height-hat.mp3", // HIHAT - Add path to hi-hat sample here
@@ -137,7 +481,22 @@ private:
 
     // Parameters
  
-    std::array<juce::AudioParameterFloat*, NUM_SOUNDS> gainParameters;
+    std::array<juce::AudioParameterFloat*, maxPads> gainParameters;
+    std::array<juce::AudioParameterBool*, maxPads> normaliseParameters;
+    std::array<juce::AudioParameterFloat*, maxPads> panParameters;
+
+    struct EnvelopeParameters
+    {
+        juce::AudioParameterFloat* attack = nullptr;
+        juce::AudioParameterFloat* hold = nullptr;
+        juce::AudioParameterFloat* decay = nullptr;
+        juce::AudioParameterFloat* sustain = nullptr;
+        juce::AudioParameterFloat* release = nullptr;
+        juce::AudioParameterBool* noteOff = nullptr;
+    };
+
+    std::array<EnvelopeParameters, maxPads> envelopeParameters;
+    juce::AudioParameterBool* inputTriggerParameter = nullptr;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DrumSimulatorAudioProcessor)
 };
\ No newline at end of file
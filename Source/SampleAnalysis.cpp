@@ -0,0 +1,198 @@
+#include "SampleAnalysis.h"
+
+//==============================================================================
+SampleAnalysis::Ptr SampleAnalysis::analyse(const juce::AudioBuffer<float>& buffer, juce::Range<int> region,
+    double sampleRate)
+{
+    Ptr analysis(new SampleAnalysis());
+    analysis->region = region.getIntersectionWith({ 0, buffer.getNumSamples() });
+
+    if (!analysis->region.isEmpty() && buffer.getNumChannels() > 0)
+    {
+        analysis->buildThumbnail(buffer);
+        analysis->measureLevels(buffer, sampleRate);
+    }
+
+    return analysis;
+}
+
+float SampleAnalysis::getNormalisationGain(float targetLufs) const noexcept
+{
+    // Near-silent regions have no meaningful loudness to correct
+    if (integratedLoudness <= -70.0f)
+        return 1.0f;
+
+    return juce::Decibels::decibelsToGain(juce::jlimit(-20.0f, 20.0f, targetLufs - integratedLoudness));
+}
+
+juce::Range<float> SampleAnalysis::getColumnRange(int column, int numColumns) const noexcept
+{
+    if (levels.empty() || numColumns <= 0)
+        return {};
+
+    auto samplesPerColumn = region.getLength() / (double)numColumns;
+
+    // Coarsest level whose bins are no wider than a column
+    size_t levelIndex = 0;
+    while (levelIndex + 1 < levels.size() && levels[levelIndex + 1].samplesPerBin <= samplesPerColumn)
+        ++levelIndex;
+
+    const auto& level = levels[levelIndex];
+    auto numBins = (int)level.bins.size();
+    auto firstBin = juce::jlimit(0, numBins - 1, (int)(column * samplesPerColumn / level.samplesPerBin));
+    auto endBin = juce::jlimit(firstBin + 1, numBins, (int)((column + 1) * samplesPerColumn / level.samplesPerBin));
+
+    auto range = level.bins[(size_t)firstBin];
+    for (auto bin = firstBin + 1; bin < endBin; ++bin)
+        range = range.getUnionWith(level.bins[(size_t)bin]);
+
+    return range;
+}
+
+//==============================================================================
+void SampleAnalysis::buildThumbnail(const juce::AudioBuffer<float>& buffer)
+{
+    auto length = region.getLength();
+
+    // The finest level is read straight from the samples, a bin at a time
+    ThumbnailLevel base;
+    base.samplesPerBin = baseSamplesPerBin;
+    base.bins.resize((size_t)((length + baseSamplesPerBin - 1) / baseSamplesPerBin));
+
+    for (size_t bin = 0; bin < base.bins.size(); ++bin)
+    {
+        auto start = region.getStart() + (int)bin * baseSamplesPerBin;
+        auto numSamples = juce::jmin(baseSamplesPerBin, region.getEnd() - start);
+
+        auto range = juce::FloatVectorOperations::findMinAndMax(buffer.getReadPointer(0, start), numSamples);
+        for (int channel = 1; channel < buffer.getNumChannels(); ++channel)
+            range = range.getUnionWith(juce::FloatVectorOperations::findMinAndMax(buffer.getReadPointer(channel, start), numSamples));
+
+        base.bins[bin] = range;
+        peak = juce::jmax(peak, -range.getStart(), range.getEnd());
+    }
+
+    levels.push_back(std::move(base));
+
+    // Each coarser level merges groups of bins from the one below
+    while (levels.back().bins.size() > 1)
+    {
+        const auto& finer = levels.back();
+
+        ThumbnailLevel coarser;
+        coarser.samplesPerBin = finer.samplesPerBin * levelFactor;
+        coarser.bins.resize((finer.bins.size() + levelFactor - 1) / levelFactor);
+
+        for (size_t bin = 0; bin < coarser.bins.size(); ++bin)
+        {
+            auto first = bin * levelFactor;
+            auto end = juce::jmin(first + levelFactor, finer.bins.size());
+
+            auto range = finer.bins[first];
+            for (auto i = first + 1; i < end; ++i)
+                range = range.getUnionWith(finer.bins[i]);
+
+            coarser.bins[bin] = range;
+        }
+
+        levels.push_back(std::move(coarser));
+    }
+}
+
+void SampleAnalysis::measureLevels(const juce::AudioBuffer<float>& buffer, double sampleRate)
+{
+    auto length = region.getLength();
+    auto numChannels = buffer.getNumChannels();
+
+    double sumOfSquares = 0.0;
+    for (int channel = 0; channel < numChannels; ++channel)
+        sumOfSquares += juce::square((double)buffer.getRMSLevel(channel, region.getStart(), length)) * length;
+
+    rms = (float)std::sqrt(sumOfSquares / ((double)numChannels * length));
+
+    // K-weighting pre-filter and high-pass from BS.1770, derived for this rate
+    auto shelfK = std::tan(juce::MathConstants<double>::pi * 1681.974450955533 / sampleRate);
+    auto shelfQ = 0.7071752369554196;
+    auto vh = std::pow(10.0, 3.999843853973347 / 20.0);
+    auto vb = std::pow(vh, 0.4996667741545416);
+    juce::IIRCoefficients shelf(vh + vb * shelfK / shelfQ + shelfK * shelfK, 2.0 * (shelfK * shelfK - vh),
+        vh - vb * shelfK / shelfQ + shelfK * shelfK,
+        1.0 + shelfK / shelfQ + shelfK * shelfK, 2.0 * (shelfK * shelfK - 1.0), 1.0 - shelfK / shelfQ + shelfK * shelfK);
+
+    auto highPassK = std::tan(juce::MathConstants<double>::pi * 38.13547087602444 / sampleRate);
+    auto highPassQ = 0.5003270373238773;
+    juce::IIRCoefficients highPass(1.0, -2.0, 1.0,
+        1.0 + highPassK / highPassQ + highPassK * highPassK, 2.0 * (highPassK * highPassK - 1.0),
+        1.0 - highPassK / highPassQ + highPassK * highPassK);
+
+    // Mean square of the weighted signal in 100 ms steps, summed over channels
+    auto hopLength = juce::jmax(1, (int)(sampleRate * 0.1));
+    auto numHops = (length + hopLength - 1) / hopLength;
+    std::vector<double> hopEnergy((size_t)numHops, 0.0);
+    juce::HeapBlock<float> weighted((size_t)length);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        juce::FloatVectorOperations::copy(weighted, buffer.getReadPointer(channel, region.getStart()), length);
+
+        juce::IIRFilter shelfFilter, highPassFilter;
+        shelfFilter.setCoefficients(shelf);
+        highPassFilter.setCoefficients(highPass);
+        shelfFilter.processSamples(weighted, length);
+        highPassFilter.processSamples(weighted, length);
+
+        juce::FloatVectorOperations::multiply(weighted, weighted, length);
+
+        for (int hop = 0; hop < numHops; ++hop)
+        {
+            auto start = hop * hopLength;
+            auto end = juce::jmin(length, start + hopLength);
+            hopEnergy[(size_t)hop] += std::accumulate(weighted + start, weighted + end, 0.0);
+        }
+    }
+
+    // Gating blocks are 400 ms long with 75% overlap; shorter hits are
+    // measured as a single block
+    constexpr int hopsPerBlock = 4;
+    std::vector<double> blockPowers;
+
+    if (numHops < hopsPerBlock)
+    {
+        blockPowers.push_back(std::accumulate(hopEnergy.begin(), hopEnergy.end(), 0.0) / length);
+    }
+    else
+    {
+        for (int block = 0; block + hopsPerBlock <= numHops; ++block)
+        {
+            auto energy = std::accumulate(hopEnergy.begin() + block, hopEnergy.begin() + block + hopsPerBlock, 0.0);
+            blockPowers.push_back(energy / (hopsPerBlock * hopLength));
+        }
+    }
+
+    auto toLoudness = [](double power) { return -0.691 + 10.0 * std::log10(juce::jmax(power, 1.0e-20)); };
+
+    auto gatedMean = [&blockPowers, &toLoudness](double gateLufs)
+    {
+        double sum = 0.0;
+        int count = 0;
+
+        for (auto power : blockPowers)
+        {
+            if (toLoudness(power) > gateLufs)
+            {
+                sum += power;
+                ++count;
+            }
+        }
+
+        return count > 0 ? sum / count : 0.0;
+    };
+
+    // Absolute gate at -70 LUFS, then a relative gate 10 LU below what's left
+    auto absoluteMean = gatedMean(-70.0);
+    if (absoluteMean <= 0.0)
+        return;
+
+    auto relativeMean = gatedMean(toLoudness(absoluteMean) - 10.0);
+    integratedLoudness = (float)toLoudness(relativeMean > 0.0 ? relativeMean : absoluteMean);
+}
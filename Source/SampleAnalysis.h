@@ -0,0 +1,53 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+// Waveform thumbnail and level statistics for one region of a decoded sample.
+// Built once on a background thread and read-only afterwards.
+class SampleAnalysis : public juce::ReferenceCountedObject
+{
+public:
+    using Ptr = juce::ReferenceCountedObjectPtr<SampleAnalysis>;
+
+    static Ptr analyse(const juce::AudioBuffer<float>& buffer, juce::Range<int> region, double sampleRate);
+
+    juce::Range<int> getRegion() const noexcept { return region; }
+
+    float getPeak() const noexcept { return peak; }
+    float getRms() const noexcept { return rms; }
+
+    // ITU-R BS.1770 integrated loudness, in LUFS
+    float getIntegratedLoudness() const noexcept { return integratedLoudness; }
+
+    // Gain that brings the region to targetLufs, limited to +/-20 dB
+    float getNormalisationGain(float targetLufs) const noexcept;
+
+    // Min/max of the waveform under one column when it is drawn numColumns
+    // wide, taken from the coarsest thumbnail level that still resolves it
+    juce::Range<float> getColumnRange(int column, int numColumns) const noexcept;
+
+private:
+    SampleAnalysis() = default;
+
+    void buildThumbnail(const juce::AudioBuffer<float>& buffer);
+    void measureLevels(const juce::AudioBuffer<float>& buffer, double sampleRate);
+
+    // Each thumbnail level is levelFactor times coarser than the one before
+    static constexpr int baseSamplesPerBin = 32;
+    static constexpr int levelFactor = 4;
+
+    struct ThumbnailLevel
+    {
+        int samplesPerBin = 0;
+        std::vector<juce::Range<float>> bins;
+    };
+
+    juce::Range<int> region;
+    std::vector<ThumbnailLevel> levels;
+    float peak = 0.0f;
+    float rms = 0.0f;
+    float integratedLoudness = -100.0f;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SampleAnalysis)
+};
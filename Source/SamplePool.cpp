@@ -0,0 +1,549 @@
+#include "SamplePool.h"
+
+#if JUCE_WINDOWS
+ #ifndef NOMINMAX
+  #define NOMINMAX
+ #endif
+ #include <windows.h>
+#else
+ #include <sys/mman.h>
+#endif
+
+namespace
+{
+    bool lockMemory(const void* address, size_t numBytes)
+    {
+       #if JUCE_WINDOWS
+        return VirtualLock(const_cast<void*>(address), numBytes) != 0;
+       #else
+        return mlock(address, numBytes) == 0;
+       #endif
+    }
+
+    void unlockMemory(const void* address, size_t numBytes)
+    {
+       #if JUCE_WINDOWS
+        VirtualUnlock(const_cast<void*>(address), numBytes);
+       #else
+        munlock(address, numBytes);
+       #endif
+    }
+
+    // Low-passes one channel below targetRate's Nyquist limit. Run forwards
+    // and then backwards, so the filter adds no phase shift and attacks stay
+    // where they were.
+    void removeAliasingContent(juce::AudioBuffer<float>& buffer, int channel, double sourceRate, double targetRate)
+    {
+        // Q of each section of an 8th order Butterworth filter
+        static constexpr double sectionQs[] = { 0.5098, 0.6013, 0.9000, 2.5629 };
+        auto cutoff = targetRate * 0.45;
+        auto numSamples = buffer.getNumSamples();
+
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            for (auto q : sectionQs)
+            {
+                juce::IIRFilter filter;
+                filter.setCoefficients(juce::IIRCoefficients::makeLowPass(sourceRate, cutoff, q));
+                filter.processSamples(buffer.getWritePointer(channel), numSamples);
+            }
+
+            buffer.reverse(channel, 0, numSamples);
+        }
+    }
+
+    // Reads one value per page so the OS maps it in before the audio thread
+    // needs it, even if it can't be locked
+    void prefault(const float* data, size_t numSamples)
+    {
+        constexpr size_t samplesPerPage = 4096 / sizeof(float);
+        volatile float sink = 0.0f;
+
+        for (size_t i = 0; i < numSamples; i += samplesPerPage)
+            sink = sink + data[i];
+
+        if (numSamples > 0)
+            sink = sink + data[numSamples - 1];
+    }
+}
+
+//==============================================================================
+SharedSample::SharedSample(juce::AudioBuffer<float>&& decodedBuffer, juce::uint64 hash, double sourceRate,
+    int trimmedSamples, const SampleLoadOptions& options, const juce::String& name)
+    : buffer(std::move(decodedBuffer)),
+    contentHash(hash),
+    sampleRate(options.sampleRate > 0.0 ? options.sampleRate : sourceRate),
+    sourceSampleRate(sourceRate),
+    trimmedStart(trimmedSamples),
+    loadOptions(options),
+    sourceName(name)
+{
+}
+
+SampleAnalysis::Ptr SharedSample::findAnalysis(juce::Range<int> region) const
+{
+    const juce::ScopedLock sl(analysisLock);
+
+    for (auto* analysis : analyses)
+        if (analysis->getRegion() == region)
+            return analysis;
+
+    return nullptr;
+}
+
+bool SharedSample::beginAnalysis(juce::Range<int> region)
+{
+    const juce::ScopedLock sl(analysisLock);
+
+    if (pendingAnalyses.contains(region))
+        return false;
+
+    for (auto* analysis : analyses)
+        if (analysis->getRegion() == region)
+            return false;
+
+    pendingAnalyses.add(region);
+    return true;
+}
+
+void SharedSample::addAnalysis(SampleAnalysis::Ptr analysis)
+{
+    const juce::ScopedLock sl(analysisLock);
+    pendingAnalyses.removeFirstMatchingValue(analysis->getRegion());
+    analyses.add(analysis);
+}
+
+//==============================================================================
+SamplePool::SamplePool()
+{
+    formatManager.registerBasicFormats();
+
+    // Unused samples are released here rather than by whoever drops the last
+    // voice reference, which may be the audio thread
+    startTimer(2000);
+}
+
+SamplePool::~SamplePool()
+{
+    stopTimer();
+    backgroundThreads.removeAllJobs(true, 5000);
+
+    const juce::ScopedLock sl(lock);
+    for (auto* sample : samples)
+        unlockSampleMemory(*sample);
+}
+
+//==============================================================================
+SharedSample::Ptr SamplePool::getOrLoad(const juce::File& file, const SampleLoadOptions& options)
+{
+    juce::MemoryBlock data;
+    if (!file.loadFileAsData(data) || data.getSize() == 0)
+        return nullptr;
+
+    auto hash = hashContent(data);
+
+    if (auto existing = findSample(hash, options))
+        return existing;
+
+    // Decode outside the lock so other instances can keep hitting the cache
+    auto decoded = decode(data, hash, options, file.getFileName());
+    if (decoded == nullptr)
+        return nullptr;
+
+    const juce::ScopedLock sl(lock);
+
+    // Another instance may have finished decoding the same content meanwhile
+    for (auto* sample : samples)
+        if (matches(*sample, hash, options))
+            return sample;
+
+    samples.add(decoded);
+    requestMemoryLock(decoded);
+    return decoded;
+}
+
+void SamplePool::requestAnalysis(SharedSample::Ptr sample, juce::Range<int> region)
+{
+    if (sample == nullptr || region.isEmpty() || !sample->beginAnalysis(region))
+        return;
+
+    // The job's reference keeps the sample alive; the pool still holds its
+    // own, so releasing it on the background thread never frees the buffer
+    backgroundThreads.addJob([sample, region]
+        {
+            sample->addAnalysis(SampleAnalysis::analyse(sample->getBuffer(), region, sample->getSampleRate()));
+        });
+}
+
+void SamplePool::setMemoryLocking(MemoryLockMode mode, double attackMs, size_t budgetBytes)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        memoryLockMode = mode;
+        memoryLockAttackMs = attackMs;
+        memoryLockBudget = budgetBytes;
+    }
+
+    // Queued behind any locks already requested, so they're re-checked too
+    backgroundThreads.addJob([this] { updateMemoryLocks(); });
+}
+
+int SamplePool::getNumSamples() const
+{
+    const juce::ScopedLock sl(lock);
+    return samples.size();
+}
+
+size_t SamplePool::getTotalBytes() const
+{
+    const juce::ScopedLock sl(lock);
+
+    size_t total = 0;
+    for (auto* sample : samples)
+        total += (size_t)sample->getBuffer().getNumChannels() * (size_t)sample->getBuffer().getNumSamples() * sizeof(float);
+
+    return total;
+}
+
+juce::Array<juce::Range<int>> SamplePool::detectTransientSlices(const juce::AudioBuffer<float>& buffer,
+    double sampleRate, float thresholdDb, double minSliceMs)
+{
+    constexpr int hopSize = 64;
+    constexpr float riseRatio = 4.0f; // 12 dB jump between hops counts as a new hit
+
+    auto threshold = juce::Decibels::decibelsToGain(thresholdDb);
+    auto minSliceLength = juce::jmax(hopSize, (int)(minSliceMs * sampleRate / 1000.0));
+    auto numSamples = buffer.getNumSamples();
+
+    juce::Array<int> onsets;
+    float previousPeak = 0.0f;
+
+    for (int start = 0; start < numSamples; start += hopSize)
+    {
+        auto length = juce::jmin(hopSize, numSamples - start);
+
+        float peak = 0.0f;
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            auto range = juce::FloatVectorOperations::findMinAndMax(buffer.getReadPointer(channel, start), length);
+            peak = juce::jmax(peak, -range.getStart(), range.getEnd());
+        }
+
+        auto isOnset = peak >= threshold && peak >= previousPeak * riseRatio;
+        if (isOnset && (onsets.isEmpty() || start - onsets.getLast() >= minSliceLength))
+            onsets.add(start);
+
+        previousPeak = peak;
+    }
+
+    juce::Array<juce::Range<int>> slices;
+    for (int i = 0; i < onsets.size(); ++i)
+    {
+        auto end = i + 1 < onsets.size() ? onsets[i + 1] : numSamples;
+        slices.add({ onsets[i], end });
+    }
+
+    return slices;
+}
+
+//==============================================================================
+void SamplePool::timerCallback()
+{
+    const juce::ScopedLock sl(lock);
+
+    // A count of one means only the pool still refers to the sample
+    for (int i = samples.size(); --i >= 0;)
+    {
+        auto* sample = samples.getObjectPointerUnchecked(i);
+
+        if (sample->getReferenceCount() == 1)
+        {
+            unlockSampleMemory(*sample);
+            samples.remove(i);
+        }
+    }
+}
+
+SharedSample::Ptr SamplePool::findSample(juce::uint64 hash, const SampleLoadOptions& options) const
+{
+    const juce::ScopedLock sl(lock);
+
+    for (auto* sample : samples)
+        if (matches(*sample, hash, options))
+            return sample;
+
+    return nullptr;
+}
+
+bool SamplePool::matches(const SharedSample& sample, juce::uint64 hash, const SampleLoadOptions& options) noexcept
+{
+    if (sample.getContentHash() != hash)
+        return false;
+
+    // A rate of 0 asks for the file's own rate, whatever that turned out to be
+    auto stored = sample.getLoadOptions();
+    auto wanted = options;
+    wanted.sampleRate = options.sampleRate > 0.0 ? options.sampleRate : sample.getSourceSampleRate();
+    stored.sampleRate = sample.getSampleRate();
+
+    return stored == wanted;
+}
+
+SharedSample::Ptr SamplePool::decode(const juce::MemoryBlock& data, juce::uint64 hash,
+    const SampleLoadOptions& options, const juce::String& name)
+{
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(
+        std::make_unique<juce::MemoryInputStream>(data, false)));
+
+    if (reader == nullptr || reader->lengthInSamples <= 0)
+        return nullptr;
+
+    auto numChannels = (int)reader->numChannels;
+    auto sourceLength = (int)reader->lengthInSamples;
+    auto sourceRate = reader->sampleRate;
+
+    juce::AudioBuffer<float> buffer(numChannels, sourceLength);
+    reader->read(&buffer, 0, sourceLength, 0, true, true);
+
+    auto targetSampleRate = options.sampleRate > 0.0 ? options.sampleRate : sourceRate;
+
+    if (targetSampleRate != sourceRate)
+    {
+        // Resample once at load time so playback never has to
+        auto ratio = sourceRate / targetSampleRate;
+        auto targetLength = (int)std::ceil(sourceLength / ratio);
+        juce::AudioBuffer<float> resampled(numChannels, targetLength);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            // Content above the new Nyquist limit would alias when downsampling
+            if (ratio > 1.0)
+                removeAliasingContent(buffer, channel, sourceRate, targetSampleRate);
+
+            juce::LagrangeInterpolator interpolator;
+            interpolator.process(ratio, buffer.getReadPointer(channel), resampled.getWritePointer(channel),
+                targetLength, sourceLength, 0);
+        }
+
+        buffer = std::move(resampled);
+    }
+
+    // Drop leading and trailing silence, keeping a little pre-roll so the
+    // attack isn't clipped. Copying into a right-sized buffer releases the rest.
+    auto audible = findAudibleRange(buffer, juce::Decibels::decibelsToGain(options.silenceThresholdDb, -200.0f));
+    if (audible.isEmpty())
+        return nullptr;
+
+    auto preRoll = (int)(options.preRollMs * targetSampleRate / 1000.0);
+    auto start = juce::jmax(0, audible.getStart() - preRoll);
+    auto length = audible.getEnd() - start;
+
+    if (start > 0 || length < buffer.getNumSamples())
+    {
+        juce::AudioBuffer<float> trimmed(numChannels, length);
+        for (int channel = 0; channel < numChannels; ++channel)
+            trimmed.copyFrom(channel, 0, buffer, channel, start, length);
+
+        buffer = std::move(trimmed);
+    }
+
+    return new SharedSample(std::move(buffer), hash, sourceRate, start, options, name);
+}
+
+juce::Range<int> SamplePool::findAudibleRange(const juce::AudioBuffer<float>& buffer, float threshold) noexcept
+{
+    auto numSamples = buffer.getNumSamples();
+    int first = numSamples, last = -1;
+
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+    {
+        auto* data = buffer.getReadPointer(channel);
+
+        for (int i = 0; i < first; ++i)
+        {
+            if (std::abs(data[i]) >= threshold)
+            {
+                first = i;
+                break;
+            }
+        }
+
+        for (int i = numSamples; --i > last;)
+        {
+            if (std::abs(data[i]) >= threshold)
+            {
+                last = i;
+                break;
+            }
+        }
+    }
+
+    return last < first ? juce::Range<int>() : juce::Range<int>(first, last + 1);
+}
+
+juce::uint64 SamplePool::hashContent(const juce::MemoryBlock& data) noexcept
+{
+    // 64-bit FNV-1a over the encoded file
+    juce::uint64 hash = 0xcbf29ce484222325ull;
+    auto* bytes = static_cast<const juce::uint8*>(data.getData());
+
+    for (size_t i = 0; i < data.getSize(); ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+//==============================================================================
+void TailTable::compute(const juce::AudioBuffer<float>& buffer, juce::Range<int> region)
+{
+    constexpr int hopSize = 64;
+
+    regionLength = region.getLength();
+    ends.fill(0);
+
+    // Walk backwards one hop at a time. The loudest hop seen so far only
+    // grows, so each level is passed once, quietest first.
+    auto step = numSteps - 1;
+    auto numHops = (regionLength + hopSize - 1) / hopSize;
+
+    for (int hop = numHops; --hop >= 0 && step >= 0;)
+    {
+        auto start = hop * hopSize;
+        auto length = juce::jmin(hopSize, regionLength - start);
+
+        float peak = 0.0f;
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            auto range = juce::FloatVectorOperations::findMinAndMax(
+                buffer.getReadPointer(channel, region.getStart() + start), length);
+            peak = juce::jmax(peak, -range.getStart(), range.getEnd());
+        }
+
+        while (step >= 0 && peak >= juce::Decibels::decibelsToGain(-step * stepDb, -200.0f))
+            ends[step--] = start + length;
+    }
+}
+
+int TailTable::getEndBelow(float levelDb) const noexcept
+{
+    if (levelDb >= 0.0f)
+        return ends[0];
+
+    auto step = (int)std::ceil(-levelDb / stepDb);
+    return step < numSteps ? ends[step] : regionLength;
+}
+
+//==============================================================================
+void SamplePool::requestMemoryLock(SharedSample::Ptr sample)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        if (memoryLockMode == MemoryLockMode::none)
+            return;
+    }
+
+    backgroundThreads.addJob([this, sample] { lockSampleMemory(*sample); });
+}
+
+void SamplePool::updateMemoryLocks()
+{
+    juce::ReferenceCountedArray<SharedSample> toLock;
+
+    {
+        const juce::ScopedLock sl(lock);
+
+        // Release locks that no longer match the mode or attack length...
+        for (auto* sample : samples)
+            if (sample->lockedBytesPerChannel != getLockBytesPerChannel(*sample))
+                unlockSampleMemory(*sample);
+
+        // ...then the newest samples' until what's left fits the budget
+        for (int i = samples.size(); --i >= 0 && lockedBytes.load() > memoryLockBudget;)
+            unlockSampleMemory(*samples.getObjectPointerUnchecked(i));
+
+        if (memoryLockMode != MemoryLockMode::none)
+            toLock = samples;
+    }
+
+    for (auto* sample : toLock)
+        lockSampleMemory(*sample);
+}
+
+size_t SamplePool::getLockBytesPerChannel(const SharedSample& sample) const
+{
+    // Called with the lock held
+    if (memoryLockMode == MemoryLockMode::none)
+        return 0;
+
+    auto numSamples = sample.getBuffer().getNumSamples();
+    if (memoryLockMode == MemoryLockMode::attack)
+        numSamples = juce::jmin(numSamples, (int)(memoryLockAttackMs * sample.getSampleRate() / 1000.0));
+
+    return (size_t)numSamples * sizeof(float);
+}
+
+void SamplePool::lockSampleMemory(SharedSample& sample)
+{
+    const auto& buffer = sample.getBuffer();
+    size_t bytesPerChannel = 0;
+    bool withinBudget = false;
+
+    {
+        const juce::ScopedLock sl(lock);
+
+        if (memoryLockMode == MemoryLockMode::none || sample.lockedBytesPerChannel > 0)
+            return;
+
+        bytesPerChannel = getLockBytesPerChannel(sample);
+        auto totalBytes = bytesPerChannel * (size_t)buffer.getNumChannels();
+
+        // Reserve against the budget before locking, so concurrent requests
+        // can't overshoot it
+        withinBudget = lockedBytes.load() + totalBytes <= memoryLockBudget;
+        if (withinBudget)
+            lockedBytes += totalBytes;
+        else
+            ++lockFailures;
+    }
+
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        prefault(buffer.getReadPointer(channel), bytesPerChannel / sizeof(float));
+
+    if (!withinBudget || bytesPerChannel == 0)
+        return;
+
+    int numLocked = 0;
+    while (numLocked < buffer.getNumChannels() && lockMemory(buffer.getReadPointer(numLocked), bytesPerChannel))
+        ++numLocked;
+
+    const juce::ScopedLock sl(lock);
+
+    if (numLocked == buffer.getNumChannels())
+    {
+        sample.lockedBytesPerChannel = bytesPerChannel;
+        return;
+    }
+
+    for (int channel = 0; channel < numLocked; ++channel)
+        unlockMemory(buffer.getReadPointer(channel), bytesPerChannel);
+
+    lockedBytes -= bytesPerChannel * (size_t)buffer.getNumChannels();
+    ++lockFailures;
+}
+
+void SamplePool::unlockSampleMemory(SharedSample& sample)
+{
+    // Called with the lock held
+    if (sample.lockedBytesPerChannel == 0)
+        return;
+
+    const auto& buffer = sample.getBuffer();
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        unlockMemory(buffer.getReadPointer(channel), sample.lockedBytesPerChannel);
+
+    lockedBytes -= sample.lockedBytesPerChannel * (size_t)buffer.getNumChannels();
+    sample.lockedBytesPerChannel = 0;
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SampleAnalysis.h"
+
+//==============================================================================
+// How a file is decoded into the pool. Samples loaded with different options
+// are cached separately.
+struct SampleLoadOptions
+{
+    double sampleRate = 0.0;            // 0 keeps the file's own rate
+    float silenceThresholdDb = -90.0f;  // leading and trailing audio below this is dropped
+    double preRollMs = 1.0;             // kept ahead of the first audible sample
+
+    bool operator==(const SampleLoadOptions& other) const noexcept
+    {
+        return sampleRate == other.sampleRate
+            && silenceThresholdDb == other.silenceThresholdDb
+            && preRollMs == other.preRollMs;
+    }
+};
+
+//==============================================================================
+// Decoded sample data shared by every plugin instance in the process.
+// The buffer is never modified once the pool has published it.
+class SharedSample : public juce::ReferenceCountedObject
+{
+public:
+    using Ptr = juce::ReferenceCountedObjectPtr<SharedSample>;
+
+    SharedSample(juce::AudioBuffer<float>&& decodedBuffer, juce::uint64 hash, double sourceRate,
+        int trimmedSamples, const SampleLoadOptions& options, const juce::String& name);
+
+    const juce::AudioBuffer<float>& getBuffer() const noexcept { return buffer; }
+    juce::uint64 getContentHash() const noexcept { return contentHash; }
+    double getSampleRate() const noexcept { return sampleRate; }
+    double getSourceSampleRate() const noexcept { return sourceSampleRate; }
+    const juce::String& getSourceName() const noexcept { return sourceName; }
+
+    // Number of leading samples, at the buffer's rate, removed as silence
+    int getTrimmedStart() const noexcept { return trimmedStart; }
+    const SampleLoadOptions& getLoadOptions() const noexcept { return loadOptions; }
+
+    // Analyses of regions of this sample, cached alongside it
+    SampleAnalysis::Ptr findAnalysis(juce::Range<int> region) const;
+
+private:
+    friend class SamplePool;
+
+    // Returns false if the region is already analysed or being analysed
+    bool beginAnalysis(juce::Range<int> region);
+    void addAnalysis(SampleAnalysis::Ptr analysis);
+
+    const juce::AudioBuffer<float> buffer;
+    const juce::uint64 contentHash;
+    const double sampleRate;
+    const double sourceSampleRate;
+    const int trimmedStart;
+    const SampleLoadOptions loadOptions;
+    const juce::String sourceName;
+
+    // Bytes at the start of each channel currently locked in RAM
+    size_t lockedBytesPerChannel = 0;
+
+    mutable juce::CriticalSection analysisLock;
+    juce::ReferenceCountedArray<SampleAnalysis> analyses;
+    juce::Array<juce::Range<int>> pendingAnalyses;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SharedSample)
+};
+
+//==============================================================================
+// Process-wide cache of decoded samples, keyed by file content and sample rate.
+// Obtain it through juce::SharedResourcePointer<SamplePool> so that all plugin
+// instances share one pool, which is destroyed with the last instance.
+//
+// Samples are only ever freed from the pool's timer on the message thread, once
+// nothing but the pool itself holds a reference, so dropping a SharedSample::Ptr
+// on the audio thread can never deallocate.
+class SamplePool : private juce::Timer
+{
+public:
+    SamplePool();
+    ~SamplePool() override;
+
+    // Returns the decoded sample for this file, decoding it only if no identical
+    // content has been loaded with these options yet. Returns nullptr if the
+    // file can't be read or is entirely silent.
+    SharedSample::Ptr getOrLoad(const juce::File& file, const SampleLoadOptions& options);
+
+    // Analyses a region of a sample on the pool's background thread. The
+    // result turns up in SharedSample::findAnalysis() once it is ready.
+    void requestAnalysis(SharedSample::Ptr sample, juce::Range<int> region);
+
+    int getNumSamples() const;
+    size_t getTotalBytes() const;
+
+    //==============================================================================
+    // Keeps sample memory resident so a first hit never page-faults on the
+    // audio thread. New samples are prefaulted and locked on the background
+    // thread, either the first attackMs of each or the whole buffer, until
+    // the budget is used up. Changing the settings unlocks whatever no longer
+    // fits them.
+    enum class MemoryLockMode
+    {
+        none,
+        attack,
+        wholeSample
+    };
+
+    void setMemoryLocking(MemoryLockMode mode, double attackMs, size_t budgetBytes);
+
+    size_t getLockedBytes() const noexcept { return lockedBytes.load(); }
+
+    // Locks refused by the OS or by the budget
+    int getLockFailures() const noexcept { return lockFailures.load(); }
+
+    // Splits a buffer of consecutive hits at each onset that rises above
+    // thresholdDb. Each slice runs up to the next onset; slices closer together
+    // than minSliceMs are merged.
+    static juce::Array<juce::Range<int>> detectTransientSlices(const juce::AudioBuffer<float>& buffer,
+        double sampleRate, float thresholdDb, double minSliceMs = 50.0);
+
+private:
+    //==============================================================================
+    void timerCallback() override;
+
+    SharedSample::Ptr findSample(juce::uint64 hash, const SampleLoadOptions& options) const;
+    SharedSample::Ptr decode(const juce::MemoryBlock& data, juce::uint64 hash,
+        const SampleLoadOptions& options, const juce::String& name);
+
+    static bool matches(const SharedSample& sample, juce::uint64 hash, const SampleLoadOptions& options) noexcept;
+    static juce::Range<int> findAudibleRange(const juce::AudioBuffer<float>& buffer, float threshold) noexcept;
+
+    static juce::uint64 hashContent(const juce::MemoryBlock& data) noexcept;
+
+    void requestMemoryLock(SharedSample::Ptr sample);
+    void updateMemoryLocks();
+    size_t getLockBytesPerChannel(const SharedSample& sample) const;
+    void lockSampleMemory(SharedSample& sample);
+    void unlockSampleMemory(SharedSample& sample);
+
+    //==============================================================================
+    juce::CriticalSection lock;
+    juce::ReferenceCountedArray<SharedSample> samples;
+    juce::AudioFormatManager formatManager;
+    juce::ThreadPool backgroundThreads { 1 };
+
+    MemoryLockMode memoryLockMode = MemoryLockMode::none;
+    double memoryLockAttackMs = 200.0;
+    size_t memoryLockBudget = 0;
+    std::atomic<size_t> lockedBytes { 0 };
+    std::atomic<int> lockFailures { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SamplePool)
+};
+
+//==============================================================================
+// For a region of a sample, the position after which it never again reaches
+// each of a series of levels below full scale. Looked up per trigger so a
+// voice can stop once the rest of its tail would be inaudible at its gain.
+struct TailTable
+{
+    static constexpr int numSteps = 17;     // 0 dB down to -96 dB
+    static constexpr float stepDb = 6.0f;
+
+    void compute(const juce::AudioBuffer<float>& buffer, juce::Range<int> region);
+
+    // End of the region, relative to its start, beyond which every sample
+    // stays below levelDb. Never earlier than the true point.
+    int getEndBelow(float levelDb) const noexcept;
+
+    std::array<int, numSteps> ends {};
+    int regionLength = 0;
+};
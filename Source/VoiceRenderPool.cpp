@@ -0,0 +1,194 @@
+#include "VoiceRenderPool.h"
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+
+namespace
+{
+    inline void spinPause() noexcept
+    {
+       #if JUCE_INTEL
+        _mm_pause();
+       #endif
+    }
+
+    // Timed rather than counted, since a pause instruction takes anything
+    // from 10 to 140 cycles depending on the CPU. Longer than most gaps
+    // between segments of a block but far shorter than the gap between blocks.
+    constexpr double spinSeconds = 100.0e-6;
+
+    // Cores pinned by the workers of every pool in the process. Core 0 is
+    // left for the host and never handed out.
+    std::atomic<juce::uint32> claimedCores { 1 };
+
+    int claimCore() noexcept
+    {
+        auto numCores = juce::jmin(juce::SystemStats::getNumCpus(), 32);
+        auto claimed = claimedCores.load();
+
+        for (;;)
+        {
+            int core = 1;
+            while (core < numCores && (claimed & ((juce::uint32)1 << core)) != 0)
+                ++core;
+
+            if (core >= numCores)
+                return -1;
+
+            if (claimedCores.compare_exchange_weak(claimed, claimed | ((juce::uint32)1 << core)))
+                return core;
+        }
+    }
+
+    void releaseCore(int core) noexcept
+    {
+        claimedCores.fetch_and(~((juce::uint32)1 << core));
+    }
+}
+
+//==============================================================================
+class VoiceRenderPool::Worker : public juce::Thread
+{
+public:
+    Worker(VoiceRenderPool& ownerPool, int workerIndex, int coreToUse)
+        : juce::Thread("Voice render " + juce::String(workerIndex + 1)),
+        partition(workerIndex + 1),
+        owner(ownerPool),
+        core(coreToUse)
+    {
+    }
+
+    ~Worker() override
+    {
+        signalThreadShouldExit();
+        wakeUp.signal();
+        stopThread(1000);
+        releaseCore(core);
+    }
+
+    // Signalling takes the event's mutex, so it's only done for a worker
+    // that has actually gone to sleep. That only happens once the pool has
+    // been idle for longer than the spin, so the audio thread pays for it on
+    // the first block after a pause, never on every block.
+    void wakeIfSleeping()
+    {
+        if (sleeping.exchange(false))
+            wakeUp.signal();
+    }
+
+    // Whoever takes the flag first renders this worker's partition
+    void handOut() noexcept { pending = true; }
+    bool claim() noexcept { return pending.exchange(false); }
+
+    const int partition;
+
+    void run() override
+    {
+        // Each worker has a core to itself, so a spinning worker never
+        // competes with another one; the audio thread isn't pinned
+        juce::Thread::setCurrentThreadAffinityMask((juce::uint32)1 << core);
+
+        juce::FloatVectorOperations::disableDenormalisedNumberSupport();
+        const auto spinTicks = juce::Time::secondsToHighResolutionTicks(spinSeconds);
+
+        // Blocks are counted from when the pool was made, so one handed out
+        // before this thread got going isn't missed
+        juce::uint32 seen = 0;
+
+        while (!threadShouldExit())
+        {
+            auto spinEnd = juce::Time::getHighResolutionTicks() + spinTicks;
+            while (owner.generation.load() == seen && juce::Time::getHighResolutionTicks() < spinEnd)
+                spinPause();
+
+            if (owner.generation.load() == seen)
+            {
+                // The flag is raised before the last check, so a block handed
+                // out in between always signals the event
+                sleeping = true;
+                if (owner.generation.load() == seen)
+                    wakeUp.wait(100);
+                sleeping = false;
+                continue;
+            }
+
+            seen = owner.generation.load();
+
+            // The audio thread may have taken the partition already
+            if (claim())
+            {
+                if (auto* job = owner.currentJob.load())
+                    job->renderPartition(partition);
+
+                owner.numRemaining.fetch_sub(1);
+            }
+        }
+    }
+
+private:
+    VoiceRenderPool& owner;
+    const int core;
+    std::atomic<bool> pending { false };
+    std::atomic<bool> sleeping { false };
+    juce::WaitableEvent wakeUp;
+};
+
+//==============================================================================
+VoiceRenderPool::VoiceRenderPool(int numWorkers)
+{
+    for (int i = 0; i < numWorkers; ++i)
+    {
+        // No more workers than there are free cores to pin them to
+        auto core = claimCore();
+        if (core < 0)
+            break;
+
+        auto* worker = workers.add(new Worker(*this, workers.size(), core));
+
+        // Realtime scheduling needs an rtprio limit or CAP_SYS_NICE on Linux
+        if (!worker->startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(10))
+            && !worker->startThread(juce::Thread::Priority::highest))
+        {
+            workers.removeLast();
+        }
+    }
+}
+
+VoiceRenderPool::~VoiceRenderPool()
+{
+    workers.clear();
+}
+
+void VoiceRenderPool::run(Job& job)
+{
+    currentJob = &job;
+    numRemaining = workers.size();
+
+    for (auto* worker : workers)
+        worker->handOut();
+
+    generation.fetch_add(1);
+
+    for (auto* worker : workers)
+        worker->wakeIfSleeping();
+
+    job.renderPartition(0);
+
+    // A partition no worker has started by now belongs to one that's asleep
+    // or starved of CPU, so it's rendered here rather than waited for
+    for (auto* worker : workers)
+    {
+        if (worker->claim())
+        {
+            job.renderPartition(worker->partition);
+            numRemaining.fetch_sub(1);
+        }
+    }
+
+    // Only partitions already being rendered are left to wait for
+    while (numRemaining.load() > 0)
+        spinPause();
+
+    currentJob = nullptr;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+// A few realtime worker threads that split the voice rendering of one block
+// with the audio thread. Each worker is pinned to a core no other worker in
+// the process uses (never core 0), spins for a short while waiting for the
+// next block, and only then sleeps, so it's usually awake when the audio
+// thread hands out work. A pool gets fewer workers than asked for once the
+// free cores run out.
+class VoiceRenderPool
+{
+public:
+    struct Job
+    {
+        virtual ~Job() = default;
+        virtual void renderPartition(int partition) = 0;
+    };
+
+    explicit VoiceRenderPool(int numWorkers);
+    ~VoiceRenderPool();
+
+    // The calling thread always takes partition 0
+    int getNumPartitions() const noexcept { return workers.size() + 1; }
+
+    // Runs every partition of the job and returns once they've all finished.
+    // Partitions no worker has picked up by the time the calling thread is
+    // done with its own are rendered by the calling thread.
+    void run(Job& job);
+
+private:
+    class Worker;
+
+    juce::OwnedArray<Worker> workers;
+
+    std::atomic<Job*> currentJob { nullptr };
+    std::atomic<juce::uint32> generation { 0 };
+    std::atomic<int> numRemaining { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VoiceRenderPool)
+};
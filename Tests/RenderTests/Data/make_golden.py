@@ -0,0 +1,462 @@
+#!/usr/bin/env python3
+"""Writes the test samples and golden renders used by RenderTests.
+
+The golden renders come from this independent model of the processor's
+playback path rather than from the processor itself. It follows the same
+steps in the same order, rounding every operation to a 32-bit float:
+
+ - loading: resampling to the host rate with a 5-point Lagrange
+   interpolator, then trimming silence below -90 dB, keeping 1 ms of
+   pre-roll;
+ - each hit: velocity / 127, cut off where the sample's tail drops below
+   -80 dB at that gain (measured in 64-sample hops, 6 dB steps);
+ - the AHDSR envelope, with each level worked out from the start of its
+   stage;
+ - routing: mono samples centred, stereo samples left/right, with the mono
+   output taking the average of the two sides;
+ - mixing: voices summed in the order they started, which is the order the
+   processor keeps its active list in.
+
+Every scenario is rendered block by block at each of the test's block
+sizes, the way the processor splits its work, and must come out bit
+identical every time before anything is written.
+
+Run it again after changing scenarios.json, or after a deliberate change
+to how the default kit sounds, and check in the results.
+"""
+
+import json
+import math
+import os
+import struct
+from array import array
+
+here = os.path.dirname(os.path.abspath(__file__))
+
+default_notes = [36, 38, 42, 49, 45, 47, 48, 51]
+
+silence_threshold_db = -90.0
+pre_roll_ms = 1.0
+tail_threshold_db = -80.0
+tail_hop_size = 64
+tail_num_steps = 17
+tail_step_db = 6.0
+
+
+def f32(x):
+    return struct.unpack('<f', struct.pack('<f', x))[0]
+
+
+def f32_array(values):
+    return array('f', values).tolist()
+
+
+def decibels_to_gain(db):
+    return f32(10.0 ** f32(db * f32(0.05))) if db > -200.0 else 0.0
+
+
+def gain_to_decibels(gain):
+    return max(-100.0, f32(f32(math.log10(gain)) * 20.0)) if gain > 0.0 else -100.0
+
+
+def round_to_int(x):
+    return int(math.floor(x + 0.5))
+
+
+#==============================================================================
+def write_wav(path, channels, sample_rate):
+    num_channels = len(channels)
+    num_frames = len(channels[0])
+    data = bytearray()
+    for i in range(num_frames):
+        for channel in channels:
+            data += struct.pack('<f', channel[i])
+
+    with open(path, 'wb') as f:
+        f.write(b'RIFF')
+        f.write(struct.pack('<I', 4 + (8 + 16) + (8 + 4) + (8 + len(data))))
+        f.write(b'WAVE')
+        f.write(b'fmt ')
+        f.write(struct.pack('<IHHIIHH', 16, 3, num_channels, sample_rate,
+                            sample_rate * num_channels * 4, num_channels * 4, 32))
+        f.write(b'fact')
+        f.write(struct.pack('<II', 4, num_frames))
+        f.write(b'data')
+        f.write(struct.pack('<I', len(data)))
+        f.write(data)
+
+
+def sample_file_rate(spec, host_rate):
+    return spec.get('sampleRate', host_rate)
+
+
+def make_sample(spec, sample_rate):
+    length = spec['length']
+    decay = spec['decaySamples']
+    silence = [0.0] * spec.get('leadingSilence', 0)
+    trailing = [0.0] * spec.get('trailingSilence', 0)
+
+    def channel(phase):
+        return silence + [f32(math.exp(-n / decay)
+                              * (0.6 + 0.4 * math.cos(2 * math.pi * spec['frequency'] * n / sample_rate + phase)))
+                          for n in range(length)] + trailing
+
+    if spec.get('stereo', False):
+        return [channel(0.0), channel(math.pi / 2)]
+
+    return [channel(0.0)]
+
+
+#==============================================================================
+def lagrange_resample(source, ratio, target_length):
+    """juce::LagrangeInterpolator::process, starting from a reset state."""
+    history = [0.0] * 5
+    index = 0
+    position = 1.0
+    read = 0
+    output = []
+
+    def coefficient(k, value, offset):
+        for j in range(5):
+            if j != k:
+                value = f32(value * f32(f32(float(j - 2) - offset) * f32(1.0 / (j - k))))
+        return value
+
+    for _ in range(target_length):
+        while position >= 1.0:
+            history[index] = source[read] if read < len(source) else 0.0
+            read += 1
+            index = (index + 1) % 5
+            position -= 1.0
+
+        offset = f32(position)
+        result = 0.0
+        for k in range(5):
+            result = f32(result + coefficient(k, history[(index + k) % 5], offset))
+
+        output.append(result)
+        position += ratio
+
+    return output
+
+
+def decode(channels, source_rate, host_rate):
+    """SamplePool::decode: resample, then trim leading and trailing silence."""
+    if source_rate != host_rate:
+        ratio = source_rate / host_rate
+        assert ratio < 1.0, 'only upsampling is modelled'
+        target_length = int(math.ceil(len(channels[0]) / ratio))
+        channels = [lagrange_resample(channel, ratio, target_length) for channel in channels]
+
+    threshold = decibels_to_gain(silence_threshold_db)
+    audible = [i for i in range(len(channels[0])) if any(abs(channel[i]) >= threshold for channel in channels)]
+    assert audible, 'sample is silent'
+
+    # Nothing may sit so close to the threshold that rounding could move it
+    for channel in channels:
+        for value in channel:
+            assert abs(abs(value) - threshold) > threshold * 1e-5, 'sample level too close to the silence threshold'
+
+    pre_roll = int(pre_roll_ms * host_rate / 1000.0)
+    start = max(0, audible[0] - pre_roll)
+    return [channel[start:audible[-1] + 1] for channel in channels]
+
+
+def compute_tail(channels):
+    """TailTable::compute"""
+    length = len(channels[0])
+    ends = [0] * tail_num_steps
+    step = tail_num_steps - 1
+    num_hops = (length + tail_hop_size - 1) // tail_hop_size
+
+    for hop in range(num_hops - 1, -1, -1):
+        if step < 0:
+            break
+
+        start = hop * tail_hop_size
+        peak = max(abs(value) for channel in channels for value in channel[start:start + tail_hop_size])
+
+        # 0 dB is exact; the other steps could be a rounding away
+        for s in range(1, tail_num_steps):
+            threshold = decibels_to_gain(-s * tail_step_db)
+            assert abs(peak - threshold) > threshold * 1e-5, 'tail hop peak too close to a step'
+
+        while step >= 0 and peak >= decibels_to_gain(-step * tail_step_db):
+            ends[step] = min(length, start + tail_hop_size)
+            step -= 1
+
+    return ends, length
+
+
+def tail_end(tail, level_db):
+    """TailTable::getEndBelow"""
+    ends, length = tail
+    if level_db >= 0.0:
+        return ends[0]
+
+    steps = f32(-level_db / tail_step_db)
+    assert abs(steps - round(steps)) > 1e-3, 'hit gain too close to a tail step'
+    step = int(math.ceil(steps))
+    return ends[step] if step < tail_num_steps else length
+
+
+#==============================================================================
+ATTACK, HOLD, DECAY, SUSTAIN, RELEASE, FINISHED = range(6)
+
+
+class Voice:
+    def __init__(self, pad, sample, end, hit_gain, envelope):
+        self.pad = pad
+        self.sample = sample
+        self.end = end
+        self.gain = hit_gain
+        self.envelope = envelope
+        self.position = 0
+        self.level = 0.0
+        self.level_step = 0.0
+        self.elapsed = 0
+        self.remaining = 0
+        self.stage = ATTACK
+        self.enter_stage(ATTACK)
+
+    def get_level(self, samples_into_stage):
+        return f32(self.level + f32(self.level_step * float(samples_into_stage)))
+
+    def enter_stage(self, stage):
+        settings = self.envelope
+        self.level = self.get_level(self.elapsed)
+        self.level_step = 0.0
+        self.elapsed = 0
+        self.stage = stage
+
+        if stage == ATTACK:
+            if settings['attack'] > 0:
+                self.level = 0.0
+                self.level_step = f32(1.0 / settings['attack'])
+                self.remaining = settings['attack']
+                return
+            stage = self.stage = HOLD
+
+        if stage == HOLD:
+            self.level = 1.0
+            if settings['hold'] > 0:
+                self.remaining = settings['hold']
+                return
+            stage = self.stage = DECAY
+
+        if stage == DECAY:
+            self.level = 1.0
+            if settings['decay'] > 0:
+                self.level_step = f32(f32(settings['sustain'] - 1.0) / settings['decay'])
+                self.remaining = settings['decay']
+                return
+            stage = self.stage = SUSTAIN
+
+        if stage == SUSTAIN:
+            self.level = settings['sustain']
+            self.remaining = None
+            if settings['sustain'] > 0.0:
+                return
+
+        elif stage == RELEASE:
+            if settings['release'] > 0 and self.level > 0.0:
+                self.level_step = f32(-self.level / settings['release'])
+                self.remaining = settings['release']
+                return
+
+        self.stage = FINISHED
+        self.level = 0.0
+
+    def is_done(self):
+        return self.position >= self.end or self.stage == FINISHED
+
+    def render(self, outputs, index, routing):
+        """Adds one sample of this voice to every output it reaches."""
+        if self.is_done():
+            return
+
+        read = self.position
+        if self.level_step == 0.0:
+            if self.level != 0.0:
+                for channel, source in enumerate(self.sample):
+                    for output, target in enumerate(outputs):
+                        route_gain = f32(f32(routing[output][channel] * self.gain) * self.level)
+                        if route_gain != 0.0:
+                            target[index] = f32(target[index] + f32(source[read] * route_gain))
+        else:
+            envelope = self.get_level(self.elapsed)
+            for channel, source in enumerate(self.sample):
+                enveloped = f32(source[read] * envelope)
+                for output, target in enumerate(outputs):
+                    route_gain = f32(routing[output][channel] * self.gain)
+                    if route_gain != 0.0:
+                        target[index] = f32(target[index] + f32(enveloped * route_gain))
+
+        self.position += 1
+
+        if self.stage != SUSTAIN:
+            self.elapsed += 1
+            self.remaining -= 1
+            if self.remaining == 0:
+                self.enter_stage(self.stage + 1)
+
+
+def default_mic_pan(channel, num_channels):
+    num_centred = num_channels % 2
+    if channel < num_centred:
+        return 0.0
+    return -1.0 if (channel - num_centred) % 2 == 0 else 1.0
+
+
+def make_routing(num_sample_channels, num_outputs):
+    """updateRouting, with every gain, pan and send at its default."""
+    def balance(position, output):
+        return min(1.0, 1.0 - position) if output == 0 else min(1.0, 1.0 + position)
+
+    routing = [[0.0] * num_sample_channels for _ in range(num_outputs)]
+    for channel in range(num_sample_channels):
+        mic_pan = default_mic_pan(channel, num_sample_channels)
+        sides = [f32(balance(mic_pan, output) * balance(0.0, output)) for output in range(2)]
+
+        if num_outputs == 2:
+            for output in range(2):
+                routing[output][channel] = sides[output]
+        else:
+            routing[0][channel] = f32(f32(0.5) * f32(sides[0] + sides[1]))
+
+    return routing
+
+
+#==============================================================================
+def get_envelope(parameters, host_rate):
+    samples_per_ms = host_rate / 1000.0
+
+    def to_samples(ms):
+        exact = ms * samples_per_ms
+        assert abs(exact - math.floor(exact) - 0.5) > 1e-3, 'envelope time too close to half a sample'
+        return round_to_int(exact)
+
+    return {
+        'attack': to_samples(parameters.get('attack', 0.0)),
+        'hold': to_samples(parameters.get('hold', 0.0)),
+        'decay': to_samples(parameters.get('decay', 0.0)),
+        'release': to_samples(parameters.get('release', 100.0)),
+        'sustain': f32(parameters.get('sustain', 1.0)),
+        'noteoff': bool(parameters.get('noteoff', False)),
+    }
+
+
+def render(scenario, pads, host_rate, block_size):
+    """Plays the scenario through the model, split into blocks the way
+    processBlock splits it: at block boundaries and at every event."""
+    length = scenario['length']
+    num_outputs = scenario.get('outputChannels', 2)
+    outputs = [[0.0] * length for _ in range(num_outputs)]
+
+    note_to_pad = {}
+    for pad in sorted(pads, reverse=True):
+        note_to_pad[default_notes[pad]] = pad
+
+    # Note-ons go ahead of note-offs at the same position, as the test adds them
+    events = [(position, 0, note, velocity) for position, note, velocity in scenario['events']]
+    events += [(position, 1, note, 0) for position, note in scenario.get('noteOffs', [])]
+    events.sort(key=lambda event: (event[0], event[1]))
+
+    voices = {}
+    active = []
+    next_event = 0
+
+    def render_segment(start, end):
+        for index in range(start, end):
+            for pad in active:
+                voice = voices[pad]
+                voice.render(outputs, index, pads[pad]['routing'])
+
+        # Finished voices are retired at the end of every segment, keeping
+        # the rest in order
+        for pad in [pad for pad in active if voices[pad].is_done()]:
+            active.remove(pad)
+
+    def handle(event):
+        _, is_note_off, note, velocity = event
+        pad = note_to_pad.get(note)
+        if pad is None:
+            return
+
+        slot = pads[pad]
+        if is_note_off:
+            voice = voices.get(pad)
+            if pad in active and slot['envelope']['noteoff'] and voice.stage != RELEASE:
+                voice.enter_stage(RELEASE)
+            return
+
+        hit_gain = f32(velocity * f32(1.0 / 127.0))
+        level_db = f32(tail_threshold_db - gain_to_decibels(hit_gain))
+        voices[pad] = Voice(pad, slot['sample'], tail_end(slot['tail'], level_db), hit_gain, slot['envelope'])
+        if pad not in active:
+            active.append(pad)
+
+    for block_start in range(0, length, block_size):
+        block_end = min(length, block_start + block_size)
+        position = block_start
+
+        while next_event < len(events) and events[next_event][0] < block_end:
+            event = events[next_event]
+            render_segment(position, event[0])
+            position = event[0]
+            handle(event)
+            next_event += 1
+
+        render_segment(position, block_end)
+
+    return outputs
+
+
+#==============================================================================
+def main():
+    with open(os.path.join(here, 'scenarios.json')) as f:
+        config = json.load(f)
+
+    os.makedirs(os.path.join(here, 'Samples'), exist_ok=True)
+    os.makedirs(os.path.join(here, 'Golden'), exist_ok=True)
+
+    written = set()
+
+    for host_rate in config['sampleRates']:
+        decoded = {}
+        for name, spec in config['samples'].items():
+            file_rate = sample_file_rate(spec, host_rate)
+            channels = make_sample(spec, file_rate)
+
+            path = os.path.join(here, 'Samples', '%s_%d.wav' % (name, file_rate))
+            if path not in written:
+                write_wav(path, channels, file_rate)
+                written.add(path)
+
+            decoded[name] = decode([f32_array(channel) for channel in channels], file_rate, host_rate)
+
+        for scenario in config['scenarios']:
+            num_outputs = scenario.get('outputChannels', 2)
+            parameters = scenario.get('parameters', {})
+            pads = {}
+
+            for pad, name in scenario['pads'].items():
+                sample = decoded[name]
+                pads[int(pad)] = {
+                    'sample': sample,
+                    'tail': compute_tail(sample),
+                    'routing': make_routing(len(sample), num_outputs),
+                    'envelope': get_envelope(parameters.get(pad, {}), host_rate),
+                }
+
+            renders = [render(scenario, pads, host_rate, size) for size in config['blockSizes']]
+            for size, output in zip(config['blockSizes'], renders):
+                assert output == renders[0], '%s at %d Hz changes with %d-sample blocks' % (
+                    scenario['name'], host_rate, size)
+
+            write_wav(os.path.join(here, 'Golden', '%s_%d.wav' % (scenario['name'], host_rate)), renders[0], host_rate)
+            print('%s at %d Hz: identical at block sizes %s' % (scenario['name'], host_rate, config['blockSizes']))
+
+
+if __name__ == '__main__':
+    main()
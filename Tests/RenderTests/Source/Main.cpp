@@ -0,0 +1,45 @@
+#include <JuceHeader.h>
+#include "RenderTests.h"
+
+//==============================================================================
+// Runs the render tests headless and exits non-zero if any fail, e.g.
+//
+//     RenderTests [--data <dir>] [--record-budgets [--headroom <factor>]]
+//
+// The data directory defaults to the nearest Data folder above the executable.
+// --record-budgets rewrites Data/budgets.json from this machine's timings; do
+// that with a Release build on the reference machine, otherwise idle.
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::ArgumentList args(argc, argv);
+
+    if (args.containsOption("--data"))
+    {
+        RenderTests::dataDirectory = juce::File::getCurrentWorkingDirectory()
+            .getChildFile(args.getValueForOption("--data"));
+    }
+    else
+    {
+        auto folder = juce::File::getSpecialLocation(juce::File::currentExecutableFile).getParentDirectory();
+
+        while (!folder.getChildFile("Data/scenarios.json").existsAsFile() && folder.getParentDirectory() != folder)
+            folder = folder.getParentDirectory();
+
+        RenderTests::dataDirectory = folder.getChildFile("Data");
+    }
+
+    RenderTests::recordBudgets = args.containsOption("--record-budgets");
+    if (args.containsOption("--headroom"))
+        RenderTests::budgetHeadroom = args.getValueForOption("--headroom").getDoubleValue();
+
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure(false);
+    runner.runTestsInCategory("XZ Beats");
+
+    int numFailures = 0;
+    for (int i = 0; i < runner.getNumResults(); ++i)
+        numFailures += runner.getResult(i)->failures;
+
+    return numFailures > 0 ? 1 : 0;
+}
@@ -0,0 +1,304 @@
+#include "RenderTests.h"
+#include <numeric>
+
+juce::File RenderTests::dataDirectory;
+bool RenderTests::recordBudgets = false;
+double RenderTests::budgetHeadroom = 1.5;
+
+static RenderTests renderTests;
+
+//==============================================================================
+RenderTests::RenderTests()
+    : juce::UnitTest("Render", "XZ Beats")
+{
+}
+
+void RenderTests::runTest()
+{
+    if (formatManager.getNumKnownFormats() == 0)
+        formatManager.registerBasicFormats();
+
+    auto config = juce::JSON::parse(dataDirectory.getChildFile("scenarios.json"));
+
+    beginTest("Scenario file");
+    expect(config.isObject(), "Can't read scenarios.json from " + dataDirectory.getFullPathName());
+    if (!config.isObject())
+        return;
+
+    auto tolerance = (float)config["goldenTolerance"];
+    auto budgets = recordBudgets ? juce::var() : readBudgets();
+    std::map<int, RenderStats> measured;
+
+    for (const auto& rate : *config["sampleRates"].getArray())
+    {
+        auto sampleRate = (int)rate;
+
+        for (const auto& scenario : *config["scenarios"].getArray())
+        {
+            auto name = scenario["name"].toString();
+            beginTest(name + " at " + juce::String(sampleRate) + " Hz");
+
+            auto golden = readWav(dataDirectory.getChildFile("Golden")
+                .getChildFile(name + "_" + juce::String(sampleRate) + ".wav"));
+            juce::AudioBuffer<float> firstOutput;
+
+            for (const auto& size : *config["blockSizes"].getArray())
+            {
+                auto blockSize = (int)size;
+                RenderStats stats;
+                auto output = render(config, scenario, sampleRate, blockSize, stats);
+                auto label = name + ", " + juce::String(blockSize) + "-sample blocks";
+
+                // Hits are sample accurate, so splitting the same input into
+                // different blocks mustn't change a single bit
+                if (firstOutput.getNumSamples() == 0)
+                    firstOutput = output;
+                else
+                    expect(isBitIdentical(output, firstOutput), label + " differs from the first block size");
+
+                auto difference = getMaxDifference(output, golden);
+                expect(difference <= tolerance, label + " is " + juce::String(difference) + " away from the golden render");
+
+                if (recordBudgets)
+                {
+                    // The median of several runs, so one preempted run doesn't
+                    // set the budget
+                    std::vector<RenderStats> runs { stats };
+                    while ((int)runs.size() < numRecordingRuns)
+                    {
+                        render(config, scenario, sampleRate, blockSize, stats);
+                        runs.push_back(stats);
+                    }
+
+                    auto median = [&runs](auto member)
+                    {
+                        std::vector<std::decay_t<decltype(runs.front().*member)>> values;
+                        for (const auto& run : runs)
+                            values.push_back(run.*member);
+
+                        std::sort(values.begin(), values.end());
+                        return values[values.size() / 2];
+                    };
+
+                    auto& slowest = measured[blockSize];
+                    slowest.meanLoad = juce::jmax(slowest.meanLoad, median(&RenderStats::meanLoad));
+                    slowest.p99Load = juce::jmax(slowest.p99Load, median(&RenderStats::p99Load));
+                    slowest.peakLoad = juce::jmax(slowest.peakLoad, median(&RenderStats::peakLoad));
+                    slowest.overruns = juce::jmax(slowest.overruns, median(&RenderStats::overruns));
+                }
+                else if (auto budget = budgets[juce::Identifier(juce::String(blockSize))]; budget.isObject())
+                {
+                    expectLessOrEqual(stats.meanLoad, (double)budget["meanLoad"], label + " mean load");
+                    expectLessOrEqual(stats.p99Load, (double)budget["p99Load"], label + " 99th percentile load");
+                    expectLessOrEqual(stats.overruns, (int)budget["overruns"], label + " overruns");
+                }
+
+                logMessage(label + ": mean load " + juce::String(stats.meanLoad, 4)
+                    + ", 99th percentile " + juce::String(stats.p99Load, 4)
+                    + ", peak " + juce::String(stats.peakLoad, 4)
+                    + ", overruns " + juce::String(stats.overruns));
+            }
+        }
+    }
+
+    if (recordBudgets)
+        writeBudgets(measured);
+}
+
+juce::AudioBuffer<float> RenderTests::render(const juce::var& config, const juce::var& scenario, int sampleRate,
+    int blockSize, RenderStats& stats)
+{
+    DrumSimulatorAudioProcessor processor;
+
+    if ((int)scenario.getProperty("outputChannels", 2) == 1)
+        expect(processor.setChannelLayoutOfBus(false, 0, juce::AudioChannelSet::mono()), "Can't switch to a mono output");
+
+    processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+    processor.prepareToPlay(sampleRate, blockSize);
+
+    auto* pads = scenario["pads"].getDynamicObject();
+    for (const auto& pad : pads->getProperties())
+    {
+        // Samples are written at the host rate unless they name their own
+        auto name = pad.value.toString();
+        auto spec = config["samples"][juce::Identifier(name)];
+        auto fileRate = spec.hasProperty("sampleRate") ? (int)spec["sampleRate"] : sampleRate;
+
+        auto drumIndex = pad.name.toString().getIntValue();
+        auto file = dataDirectory.getChildFile("Samples")
+            .getChildFile(name + "_" + juce::String(fileRate) + ".wav");
+
+        processor.loadSample(drumIndex, file);
+        expect(processor.isDrumLoaded(drumIndex), "Couldn't load " + file.getFullPathName());
+    }
+
+    // Per-pad parameters by their ID suffix, e.g. "attack" for "<pad>_attack"
+    if (auto* parameters = scenario["parameters"].getDynamicObject())
+    {
+        for (const auto& pad : parameters->getProperties())
+        {
+            auto prefix = DrumSimulatorAudioProcessor::getParameterPrefix(pad.name.toString().getIntValue());
+
+            for (const auto& setting : pad.value.getDynamicObject()->getProperties())
+            {
+                auto* parameter = processor.parameters.getParameter(prefix + "_" + setting.name.toString());
+                expect(parameter != nullptr, "No parameter " + prefix + "_" + setting.name.toString());
+
+                if (parameter != nullptr)
+                    parameter->setValueNotifyingHost(parameter->convertTo0to1((float)setting.value));
+            }
+        }
+    }
+
+    // The whole script as timed MIDI messages
+    std::vector<std::pair<int, juce::MidiMessage>> events;
+
+    for (const auto& event : *scenario["events"].getArray())
+        events.emplace_back((int)event[0], juce::MidiMessage::noteOn(10, (int)event[1], (juce::uint8)(int)event[2]));
+
+    if (auto* noteOffs = scenario["noteOffs"].getArray())
+        for (const auto& event : *noteOffs)
+            events.emplace_back((int)event[0], juce::MidiMessage::noteOff(10, (int)event[1]));
+
+    std::stable_sort(events.begin(), events.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    auto length = (int)scenario["length"];
+    auto numChannels = processor.getTotalNumOutputChannels();
+    juce::AudioBuffer<float> output(numChannels, length);
+    juce::AudioBuffer<float> block(numChannels, blockSize);
+    juce::MidiBuffer midiMessages;
+
+    size_t nextEvent = 0;
+    std::vector<double> loads;
+    loads.reserve((size_t)(length / blockSize + 1));
+
+    for (int start = 0; start < length; start += blockSize)
+    {
+        auto numSamples = juce::jmin(blockSize, length - start);
+        block.setSize(numChannels, numSamples, false, false, true);
+        block.clear();
+
+        midiMessages.clear();
+        for (; nextEvent < events.size() && events[nextEvent].first < start + numSamples; ++nextEvent)
+            midiMessages.addEvent(events[nextEvent].second, events[nextEvent].first - start);
+
+        auto startTicks = juce::Time::getHighResolutionTicks();
+        processor.processBlock(block, midiMessages);
+        auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+
+        // Share of the block's real-time duration spent rendering it
+        loads.push_back(seconds * sampleRate / numSamples);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            output.copyFrom(channel, start, block, channel, 0, numSamples);
+    }
+
+    stats.meanLoad = std::accumulate(loads.begin(), loads.end(), 0.0) / (double)loads.size();
+    stats.peakLoad = *std::max_element(loads.begin(), loads.end());
+
+    auto p99 = loads.begin() + (std::ptrdiff_t)(loads.size() * 99 / 100);
+    std::nth_element(loads.begin(), p99, loads.end());
+    stats.p99Load = *p99;
+
+    // The processor's own count, timed around the whole of processBlock
+    stats.overruns = processor.getRenderOverruns();
+    return output;
+}
+
+juce::var RenderTests::readBudgets()
+{
+    auto file = dataDirectory.getChildFile("budgets.json");
+    auto budgets = juce::JSON::parse(file);
+
+    if (!budgets.isObject())
+    {
+        logMessage("No budgets recorded in " + file.getFullPathName() + "; run with --record-budgets on the reference machine");
+        return {};
+    }
+
+    auto machine = juce::SystemStats::getCpuModel();
+    if (budgets["cpu"].toString() != machine || budgets["build"].toString() != getBuildDescription())
+    {
+        logMessage("Budgets were recorded on " + budgets["cpu"].toString() + " (" + budgets["build"].toString()
+            + "), so loads aren't checked on " + machine + " (" + getBuildDescription() + ")");
+        return {};
+    }
+
+    return budgets["blockSizes"];
+}
+
+void RenderTests::writeBudgets(const std::map<int, RenderStats>& budgets)
+{
+    auto* blockSizes = new juce::DynamicObject();
+    for (const auto& [blockSize, stats] : budgets)
+    {
+        auto* budget = new juce::DynamicObject();
+        budget->setProperty("meanLoad", stats.meanLoad * budgetHeadroom);
+        budget->setProperty("p99Load", stats.p99Load * budgetHeadroom);
+        budget->setProperty("overruns", juce::roundToInt(std::ceil(stats.overruns * budgetHeadroom)));
+        blockSizes->setProperty(juce::String(blockSize), budget);
+    }
+
+    auto* root = new juce::DynamicObject();
+    root->setProperty("cpu", juce::SystemStats::getCpuModel());
+    root->setProperty("build", getBuildDescription());
+    root->setProperty("recorded", juce::Time::getCurrentTime().formatted("%Y-%m-%d"));
+    root->setProperty("method", "Median of " + juce::String(numRecordingRuns) + " runs of each scenario, slowest "
+        "scenario at each block size, times " + juce::String(budgetHeadroom) + " headroom");
+    root->setProperty("blockSizes", blockSizes);
+
+    auto file = dataDirectory.getChildFile("budgets.json");
+    expect(file.replaceWithText(juce::JSON::toString(juce::var(root))), "Can't write " + file.getFullPathName());
+    logMessage("Recorded budgets in " + file.getFullPathName());
+}
+
+juce::String RenderTests::getBuildDescription()
+{
+   #if JUCE_DEBUG
+    return "Debug";
+   #else
+    return "Release";
+   #endif
+}
+
+juce::AudioBuffer<float> RenderTests::readWav(const juce::File& file)
+{
+    juce::AudioBuffer<float> buffer;
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+
+    expect(reader != nullptr, "Can't read " + file.getFullPathName());
+    if (reader != nullptr)
+    {
+        buffer.setSize((int)reader->numChannels, (int)reader->lengthInSamples);
+        reader->read(&buffer, 0, buffer.getNumSamples(), 0, true, true);
+    }
+
+    return buffer;
+}
+
+bool RenderTests::isBitIdentical(const juce::AudioBuffer<float>& a, const juce::AudioBuffer<float>& b)
+{
+    if (a.getNumChannels() != b.getNumChannels() || a.getNumSamples() != b.getNumSamples())
+        return false;
+
+    for (int channel = 0; channel < a.getNumChannels(); ++channel)
+        if (memcmp(a.getReadPointer(channel), b.getReadPointer(channel), sizeof(float) * (size_t)a.getNumSamples()) != 0)
+            return false;
+
+    return true;
+}
+
+float RenderTests::getMaxDifference(const juce::AudioBuffer<float>& a, const juce::AudioBuffer<float>& b)
+{
+    if (a.getNumChannels() != b.getNumChannels() || a.getNumSamples() != b.getNumSamples())
+        return std::numeric_limits<float>::infinity();
+
+    float difference = 0.0f;
+
+    for (int channel = 0; channel < a.getNumChannels(); ++channel)
+        for (int i = 0; i < a.getNumSamples(); ++i)
+            difference = juce::jmax(difference, std::abs(a.getSample(channel, i) - b.getSample(channel, i)));
+
+    return difference;
+}
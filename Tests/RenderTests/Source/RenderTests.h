@@ -0,0 +1,55 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "../../../Source/PluginProcessor.h"
+
+//==============================================================================
+// Plays the scripted scenarios in Data/scenarios.json through the processor
+// at every listed sample rate and block size, and checks that
+//  - every block size gives bit-identical output,
+//  - the output matches the golden render written by Data/make_golden.py,
+//  - the time spent per block stays within the budget recorded for that
+//    block size in Data/budgets.json.
+//
+// Budgets only mean something on the machine and build they were measured
+// with, so they're skipped anywhere else. Recording them renders every
+// scenario several times and keeps the slowest scenario's median run, plus
+// some headroom.
+class RenderTests : public juce::UnitTest
+{
+public:
+    RenderTests();
+
+    void runTest() override;
+
+    // Where scenarios.json, budgets.json, Samples and Golden live
+    static juce::File dataDirectory;
+
+    // Measure budgets.json instead of checking against it
+    static bool recordBudgets;
+    static double budgetHeadroom;
+
+private:
+    struct RenderStats
+    {
+        double meanLoad = 0.0;
+        double p99Load = 0.0;   // 99th percentile over the blocks
+        double peakLoad = 0.0;
+        int overruns = 0;       // blocks that took longer than their real-time duration
+    };
+
+    static constexpr int numRecordingRuns = 5;
+
+    juce::AudioBuffer<float> render(const juce::var& config, const juce::var& scenario, int sampleRate,
+        int blockSize, RenderStats& stats);
+    juce::AudioBuffer<float> readWav(const juce::File& file);
+
+    juce::var readBudgets();
+    void writeBudgets(const std::map<int, RenderStats>& budgets);
+
+    static juce::String getBuildDescription();
+    static bool isBitIdentical(const juce::AudioBuffer<float>& a, const juce::AudioBuffer<float>& b);
+    static float getMaxDifference(const juce::AudioBuffer<float>& a, const juce::AudioBuffer<float>& b);
+
+    juce::AudioFormatManager formatManager;
+};
@@ -0,0 +1,177 @@
+#include "CaptureReplay.h"
+
+namespace
+{
+    template <typename Type>
+    bool readValue(juce::InputStream& input, Type& value)
+    {
+        return input.read(&value, (int)sizeof(Type)) == (int)sizeof(Type);
+    }
+}
+
+//==============================================================================
+CaptureReplay::Result CaptureReplay::run(DrumSimulatorAudioProcessor& processor, const juce::File& captureFile,
+    const juce::File& outputFile)
+{
+    Result result;
+
+    juce::FileInputStream input(captureFile);
+    if (!input.openedOk())
+    {
+        result.error = "Can't open " + captureFile.getFullPathName();
+        return result;
+    }
+
+    if (!processor.restoreCaptureHeader(input))
+    {
+        result.error = "Not a capture file, corrupt, or its samples are missing or have changed";
+        return result;
+    }
+
+    auto numChannels = juce::jmax(processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels());
+
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+    if (outputFile != juce::File())
+    {
+        outputFile.deleteFile();
+
+        if (auto stream = outputFile.createOutputStream())
+        {
+            juce::WavAudioFormat wav;
+            writer.reset(wav.createWriterFor(stream.get(), processor.getSampleRate(),
+                (unsigned int)processor.getTotalNumOutputChannels(), 32, {}, 0));
+
+            if (writer != nullptr)
+                stream.release();
+        }
+
+        if (writer == nullptr)
+        {
+            result.error = "Can't write " + outputFile.getFullPathName();
+            return result;
+        }
+    }
+
+    juce::AudioBuffer<float> buffer;
+    juce::MidiBuffer midiMessages;
+    juce::HeapBlock<juce::uint8> eventData(65536);
+    bool hasBlock = false;
+
+    auto corrupt = [&result]
+    {
+        result.error = "Capture is truncated or corrupt after block " + juce::String(result.numBlocks);
+        return result;
+    };
+
+    // Records come in B (G...) R groups; the block is rendered when its R
+    // record arrives, with the editor hits already queued
+    juce::uint8 type = 0;
+    while (readValue(input, type))
+    {
+        if (type == BlockCapture::blockRecord)
+        {
+            juce::int32 numSamples = 0;
+            double sampleRate = 0.0;
+            juce::uint8 numInputChannels = 0;
+
+            if (!readValue(input, numSamples) || !readValue(input, sampleRate) || !readValue(input, numInputChannels)
+                || numSamples < 0 || numInputChannels > numChannels)
+                return corrupt();
+
+            if (sampleRate != processor.getSampleRate() || numSamples > processor.getBlockSize())
+            {
+                auto blockSize = juce::jmax(numSamples, processor.getBlockSize());
+                processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+                processor.prepareToPlay(sampleRate, blockSize);
+            }
+
+            buffer.setSize(numChannels, numSamples, false, false, true);
+            buffer.clear();
+
+            for (int channel = 0; channel < numInputChannels; ++channel)
+                if (input.read(buffer.getWritePointer(channel), numSamples * (int)sizeof(float)) != numSamples * (int)sizeof(float))
+                    return corrupt();
+
+            midiMessages.clear();
+            juce::int32 numEvents = 0;
+            if (!readValue(input, numEvents))
+                return corrupt();
+
+            for (int i = 0; i < numEvents; ++i)
+            {
+                juce::int32 position = 0;
+                juce::uint16 numBytes = 0;
+
+                if (!readValue(input, position) || !readValue(input, numBytes)
+                    || input.read(eventData, numBytes) != numBytes)
+                    return corrupt();
+
+                midiMessages.addEvent(eventData, numBytes, position);
+            }
+
+            juce::uint16 numChanges = 0;
+            if (!readValue(input, numChanges))
+                return corrupt();
+
+            const auto& parameters = processor.getParameters();
+            for (int i = 0; i < numChanges; ++i)
+            {
+                juce::uint16 index = 0;
+                float value = 0.0f;
+
+                if (!readValue(input, index) || !readValue(input, value) || index >= parameters.size())
+                    return corrupt();
+
+                parameters.getUnchecked(index)->setValueNotifyingHost(value);
+            }
+
+            hasBlock = true;
+        }
+        else if (type == BlockCapture::triggerRecord)
+        {
+            juce::int32 drumIndex = 0;
+            float velocity = 0.0f;
+
+            if (!hasBlock || !readValue(input, drumIndex) || !readValue(input, velocity))
+                return corrupt();
+
+            processor.triggerDrum(drumIndex, velocity);
+        }
+        else if (type == BlockCapture::renderRecord)
+        {
+            double capturedSeconds = 0.0;
+            juce::uint64 capturedHash = 0;
+
+            if (!hasBlock || !readValue(input, capturedSeconds) || !readValue(input, capturedHash))
+                return corrupt();
+
+            auto startTicks = juce::Time::getHighResolutionTicks();
+            processor.processBlock(buffer, midiMessages);
+            auto replaySeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+
+            if (result.firstMismatch < 0
+                && BlockCapture::hashOutput(buffer, processor.getTotalNumOutputChannels()) != capturedHash)
+                result.firstMismatch = result.numBlocks;
+
+            if (writer != nullptr)
+                writer->writeFromAudioSampleBuffer(buffer, 0, buffer.getNumSamples());
+
+            result.capturedRenderSeconds += capturedSeconds;
+            result.capturedPeakSeconds = juce::jmax(result.capturedPeakSeconds, capturedSeconds);
+            result.replayRenderSeconds += replaySeconds;
+            result.replayPeakSeconds = juce::jmax(result.replayPeakSeconds, replaySeconds);
+
+            ++result.numBlocks;
+            hasBlock = false;
+        }
+        else
+        {
+            return corrupt();
+        }
+    }
+
+    // A trailing block without its render record is where an overflowed
+    // capture stopped
+    result.succeeded = true;
+    return result;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "../../../Source/PluginProcessor.h"
+
+//==============================================================================
+// Plays a file written by DrumSimulatorAudioProcessor::startCapture() back
+// through a processor with no host or audio device, block for block, and
+// checks each block's output against the hash taken live.
+class CaptureReplay
+{
+public:
+    struct Result
+    {
+        bool succeeded = false;
+        juce::String error;
+
+        int numBlocks = 0;
+        int firstMismatch = -1;  // first block whose output differed, or -1
+
+        double capturedRenderSeconds = 0.0;
+        double capturedPeakSeconds = 0.0;
+        double replayRenderSeconds = 0.0;
+        double replayPeakSeconds = 0.0;
+    };
+
+    // The processor should be freshly constructed. If outputFile is given
+    // the replayed audio is written to it as a WAV file.
+    static Result run(DrumSimulatorAudioProcessor& processor, const juce::File& captureFile,
+        const juce::File& outputFile = {});
+};
@@ -0,0 +1,48 @@
+#include <JuceHeader.h>
+#include "CaptureReplay.h"
+
+//==============================================================================
+// Replays a block capture through the drum processor for profiling and
+// bisecting, e.g.
+//
+//     CaptureReplay session.xzcap [replayed.wav]
+//
+// Exits with 0 only if every block's output matched the capture.
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::ArgumentList args(argc, argv);
+
+    if (args.size() < 1)
+    {
+        std::cout << "Usage: " << args.executableName << " <capture file> [output.wav]" << std::endl;
+        return 1;
+    }
+
+    DrumSimulatorAudioProcessor processor;
+    auto result = CaptureReplay::run(processor, args[0].resolveAsFile(),
+        args.size() > 1 ? args[1].resolveAsFile() : juce::File());
+
+    if (!result.succeeded)
+    {
+        std::cout << result.error << std::endl;
+        return 1;
+    }
+
+    auto toMs = [](double seconds) { return juce::String(seconds * 1000.0, 3) + " ms"; };
+
+    std::cout << "Blocks: " << result.numBlocks << std::endl
+              << "Captured render: " << toMs(result.capturedRenderSeconds)
+              << " total, " << toMs(result.capturedPeakSeconds) << " peak" << std::endl
+              << "Replayed render: " << toMs(result.replayRenderSeconds)
+              << " total, " << toMs(result.replayPeakSeconds) << " peak" << std::endl;
+
+    if (result.firstMismatch >= 0)
+    {
+        std::cout << "Output differs from the capture from block " << result.firstMismatch << std::endl;
+        return 2;
+    }
+
+    std::cout << "Output matches the capture" << std::endl;
+    return 0;
+}